@@ -0,0 +1,69 @@
+#ifndef SJTU_BENCH_BENCH_HPP_
+#define SJTU_BENCH_BENCH_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+/**
+ * Helpers shared by the benchmark drivers in bench/, each of
+ * which is a standalone program printing one line per
+ * measurement. See the Makefile for how they are built.
+ */
+namespace bench {
+
+/// Keeps the compiler from optimizing value, or its computation, away.
+template <typename T>
+inline auto keep (const T &value) -> void {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/// Runs fn reps times, and returns the least wall time of a run, in ms.
+template <typename Fn>
+auto bestOf (int reps, Fn &&fn) -> double {
+  double best = 0;
+  for (int i = 0; i < reps; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double, std::milli> time = std::chrono::steady_clock::now() - start;
+    if (i == 0 || time.count() < best) best = time.count();
+  }
+  return best;
+}
+
+/// Prints a measurement, with the time per operation if ops > 0.
+inline auto report (const char *name, size_t n, double ms, size_t ops = 0) -> void {
+  if (ops == 0) {
+    std::printf("%-40s n=%-10zu %10.3f ms\n", name, n, ms);
+  } else {
+    std::printf("%-40s n=%-10zu %10.3f ms %8.2f ns/op\n", name, n, ms, ms * 1e6 / double(ops));
+  }
+  std::fflush(stdout);
+}
+
+/// The size argument of the driver, if any, or fallback.
+inline auto sizeArg (int argc, char **argv, int index, size_t fallback) -> size_t {
+  if (argc <= index) return fallback;
+  return std::strtoull(argv[index], nullptr, 10);
+}
+
+/// n distinct pseudo-random keys, in random order.
+template <typename Vector>
+auto randomKeys (size_t n, unsigned seed = 42) -> Vector {
+  Vector keys;
+  std::mt19937_64 rng(seed);
+  for (size_t i = 0; i < n; ++i) keys.push_back(static_cast<int>(i));
+  for (size_t i = n; i > 1; --i) {
+    size_t j = rng() % i;
+    auto tmp = keys[i - 1];
+    keys[i - 1] = keys[j];
+    keys[j] = tmp;
+  }
+  return keys;
+}
+
+} // namespace bench
+
+#endif // SJTU_BENCH_BENCH_HPP_
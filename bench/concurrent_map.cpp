@@ -0,0 +1,96 @@
+// Read throughput of concurrent_map as readers are added,
+// with one writer updating all the while, against a map
+// behind a std::shared_mutex. The reader counts are the
+// arguments, 1, 4, 16 and 64 by default.
+#include "bench.hpp"
+#include "concurrent_map.hpp"
+#include "map.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr int kKeys = 100000;
+constexpr size_t kReadsPerThread = 1000000;
+
+/// A map with a reader-writer lock, for comparison.
+class LockedMap {
+ public:
+  auto count (int key) const -> size_t {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return map_.count(key);
+  }
+  auto insert (int key) -> void {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    map_[key] = key;
+  }
+  auto erase (int key) -> void {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    map_.erase(key);
+  }
+ private:
+  mutable std::shared_mutex mutex_;
+  sjtu::map<int, int> map_;
+};
+
+auto insertInto (sjtu::concurrent_map<int, int> &map, int key) -> void {
+  map.insert(sjtu::pair<const int, int>(key, key));
+}
+auto insertInto (LockedMap &map, int key) -> void {
+  map.insert(key);
+}
+
+/// Runs the readers, and returns millions of reads per second, in total.
+template <typename Map>
+auto run (Map &map, size_t readers) -> double {
+  std::atomic<bool> stop { false };
+  // the writer keeps replacing keys beyond the readers' range.
+  std::thread writer([&] {
+    for (int key = kKeys; !stop.load(std::memory_order_relaxed); ++key) {
+      insertInto(map, key);
+      map.erase(key);
+    }
+  });
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t t = 0; t < readers; ++t) {
+    threads.emplace_back([&, t] {
+      std::mt19937 rng(static_cast<unsigned>(t));
+      size_t found = 0;
+      for (size_t i = 0; i < kReadsPerThread; ++i) found += map.count(static_cast<int>(rng() % kKeys));
+      bench::keep(found);
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+  stop.store(true);
+  writer.join();
+  return double(readers * kReadsPerThread) / time.count() / 1e6;
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  std::vector<size_t> counts;
+  for (int i = 1; i < argc; ++i) counts.push_back(bench::sizeArg(argc, argv, i, 1));
+  if (counts.empty()) counts = { 1, 4, 16, 64 };
+  std::printf("%u hardware threads\n", std::thread::hardware_concurrency());
+  sjtu::concurrent_map<int, int> concurrent;
+  LockedMap locked;
+  concurrent.update([] (auto &version) {
+    for (int key = 0; key < kKeys; ++key) version.insert(sjtu::pair<const int, int>(key, key));
+  });
+  for (int key = 0; key < kKeys; ++key) locked.insert(key);
+  for (size_t readers : counts) {
+    double lockFree = run(concurrent, readers);
+    double shared = run(locked, readers);
+    std::printf("readers=%-4zu concurrent_map %8.2f Mreads/s  shared_mutex %8.2f Mreads/s\n",
+      readers, lockFree, shared);
+    std::fflush(stdout);
+  }
+  return 0;
+}
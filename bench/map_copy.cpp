@@ -0,0 +1,47 @@
+// Copying a map on one thread, by the copy assignment, and
+// on several, by map::assign: the time of each and its
+// speedup over the serial copy. Forking pays off only with
+// cores to run on; see the hardware concurrency printed
+// first.
+#include "bench.hpp"
+#include "map.hpp"
+
+#include <thread>
+#include <vector>
+
+namespace {
+
+template <typename Map>
+auto run (const char *name, const std::vector<int> &keys) -> void {
+  size_t n = keys.size();
+  char label[64];
+  Map source;
+  for (int key : keys) source[key] = key;
+  Map copy;
+  double serial = bench::bestOf(5, [&] {
+    copy = source;
+    bench::keep(copy.size());
+  });
+  std::snprintf(label, sizeof(label), "copy/%s", name);
+  bench::report(label, n, serial, n);
+  for (size_t threads : { 2, 4, 8 }) {
+    double ms = bench::bestOf(5, [&] {
+      copy.assign(source, threads);
+      bench::keep(copy.size());
+    });
+    std::snprintf(label, sizeof(label), "assign/%zu threads/%s", threads, name);
+    bench::report(label, n, ms, n);
+    std::printf("%-40s %.2fx the serial copy\n", label, serial / ms);
+  }
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  size_t n = bench::sizeArg(argc, argv, 1, 2000000);
+  std::printf("hardware concurrency: %u\n", std::thread::hardware_concurrency());
+  auto keys = bench::randomKeys<std::vector<int>>(n);
+  run<sjtu::map<int, int>>("map", keys);
+  run<sjtu::ranked_map<int, int>>("ranked_map", keys);
+  return 0;
+}
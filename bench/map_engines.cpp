@@ -0,0 +1,65 @@
+// The map engines against each other and std::map, on
+// random int keys: inserting all keys, finding each once,
+// scanning in order, and erasing all keys. The sizes are
+// the arguments, 10^3 to 10^7 by default.
+#include "bench.hpp"
+#include "map.hpp"
+
+#include <map>
+#include <vector>
+
+namespace {
+
+template <typename Map>
+auto run (const char *name, const std::vector<int> &keys) -> void {
+  size_t n = keys.size();
+  // small maps are run over and over, for measurable times.
+  size_t rounds = n >= 1000000 ? 1 : 1000000 / n;
+  char label[64];
+  double insert = 0, find = 0, scan = 0, erase = 0;
+  for (size_t round = 0; round < rounds; ++round) {
+    Map map;
+    auto start = std::chrono::steady_clock::now();
+    for (int key : keys) map[key] = key;
+    auto inserted = std::chrono::steady_clock::now();
+    long sum = 0;
+    for (int key : keys) sum += map.find(key)->second;
+    bench::keep(sum);
+    auto found = std::chrono::steady_clock::now();
+    for (const auto &entry : map) sum += entry.second;
+    bench::keep(sum);
+    auto scanned = std::chrono::steady_clock::now();
+    for (int key : keys) map.erase(map.find(key));
+    auto erased = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> a = inserted - start, b = found - inserted,
+      c = scanned - found, d = erased - scanned;
+    insert += a.count();
+    find += b.count();
+    scan += c.count();
+    erase += d.count();
+  }
+  size_t ops = n * rounds;
+  std::snprintf(label, sizeof(label), "insert/%s", name);
+  bench::report(label, n, insert, ops);
+  std::snprintf(label, sizeof(label), "find/%s", name);
+  bench::report(label, n, find, ops);
+  std::snprintf(label, sizeof(label), "scan/%s", name);
+  bench::report(label, n, scan, ops);
+  std::snprintf(label, sizeof(label), "erase/%s", name);
+  bench::report(label, n, erase, ops);
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  std::vector<size_t> sizes;
+  for (int i = 1; i < argc; ++i) sizes.push_back(bench::sizeArg(argc, argv, i, 0));
+  if (sizes.empty()) sizes = { 1000, 10000, 100000, 1000000, 10000000 };
+  for (size_t n : sizes) {
+    auto keys = bench::randomKeys<std::vector<int>>(n);
+    run<sjtu::map<int, int>>("map", keys);
+    run<sjtu::btree_map<int, int>>("btree_map", keys);
+    run<std::map<int, int>>("std::map", keys);
+  }
+  return 0;
+}
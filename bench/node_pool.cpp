@@ -0,0 +1,53 @@
+// Node allocation in the red-black tree: building, churn
+// (erasing and inserting in turn, which recycles nodes
+// through the free list of the pool) and teardown, against
+// std::map, which allocates every node on its own.
+#include "bench.hpp"
+#include "map.hpp"
+
+#include <map>
+#include <vector>
+
+namespace {
+
+template <typename Map>
+auto run (const char *name, const std::vector<int> &keys) -> void {
+  size_t n = keys.size();
+  char label[64];
+  double build = 0, churn = 0, teardown = 0;
+  int reps = 5;
+  for (int rep = 0; rep < reps; ++rep) {
+    auto *map = new Map;
+    auto start = std::chrono::steady_clock::now();
+    for (int key : keys) (*map)[key] = key;
+    auto built = std::chrono::steady_clock::now();
+    // replace the keys one by one, oldest first.
+    for (size_t i = 0; i < n; ++i) {
+      map->erase(map->find(keys[i]));
+      (*map)[static_cast<int>(n + i)] = 0;
+    }
+    auto churned = std::chrono::steady_clock::now();
+    delete map;
+    auto done = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> a = built - start, b = churned - built, c = done - churned;
+    if (rep == 0 || a.count() < build) build = a.count();
+    if (rep == 0 || b.count() < churn) churn = b.count();
+    if (rep == 0 || c.count() < teardown) teardown = c.count();
+  }
+  std::snprintf(label, sizeof(label), "build/%s", name);
+  bench::report(label, n, build, n);
+  std::snprintf(label, sizeof(label), "churn/%s", name);
+  bench::report(label, n, churn, n);
+  std::snprintf(label, sizeof(label), "teardown/%s", name);
+  bench::report(label, n, teardown, n);
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  size_t n = bench::sizeArg(argc, argv, 1, 1000000);
+  auto keys = bench::randomKeys<std::vector<int>>(n);
+  run<sjtu::map<int, int>>("sjtu::map", keys);
+  run<std::map<int, int>>("std::map", keys);
+  return 0;
+}
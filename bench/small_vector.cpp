@@ -0,0 +1,69 @@
+// Short-lived vectors of a few elements each, as small_vector
+// and as vector: the time to fill, sum and drop one, and the
+// allocations and reallocations it takes, counted by the
+// allocator. The length of each vector is drawn from
+// [0, 2 * inline capacity), so that about half of them
+// outgrow the inline buffer.
+#include "bench.hpp"
+#include "small_vector.hpp"
+#include "vector.hpp"
+
+#include <vector>
+
+namespace {
+
+size_t allocations = 0;
+
+/// sjtu::allocator, counting the calls to allocate and reallocate.
+template <typename T>
+class CountingAllocator : public sjtu::allocator<T> {
+ public:
+  CountingAllocator () = default;
+  template <typename U>
+  CountingAllocator (const CountingAllocator<U> &/* unused */) noexcept {}
+  auto allocate (size_t n) -> T * {
+    ++allocations;
+    return sjtu::allocator<T>::allocate(n);
+  }
+  auto reallocate (T *p, size_t nOld, size_t nNew) -> T * {
+    ++allocations;
+    return sjtu::allocator<T>::reallocate(p, nOld, nNew);
+  }
+  template <typename U>
+  struct rebind {
+    using other = CountingAllocator<U>;
+  };
+};
+
+constexpr size_t kInline = 8;
+
+template <typename Vector>
+auto run (const char *name, const std::vector<int> &lengths) -> void {
+  size_t n = lengths.size();
+  char label[64];
+  allocations = 0;
+  double ms = bench::bestOf(5, [&] {
+    long sum = 0;
+    for (int length : lengths) {
+      Vector vector;
+      for (int i = 0; i < length; ++i) vector.push_back(i);
+      for (int i = 0; i < length; ++i) sum += vector[i];
+    }
+    bench::keep(sum);
+  });
+  std::snprintf(label, sizeof(label), "fill+sum/%s", name);
+  bench::report(label, n, ms, n);
+  std::printf("%-40s %.3f allocator calls per vector\n", name, double(allocations) / 5 / double(n));
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  size_t n = bench::sizeArg(argc, argv, 1, 1000000);
+  std::vector<int> lengths;
+  std::mt19937 rng(1);
+  for (size_t i = 0; i < n; ++i) lengths.push_back(static_cast<int>(rng() % (2 * kInline)));
+  run<sjtu::small_vector<int, kInline, sjtu::doubling_growth, CountingAllocator<int>>>("small_vector<int, 8>", lengths);
+  run<sjtu::vector<int, sjtu::doubling_growth, CountingAllocator<int>>>("vector<int>", lengths);
+  return 0;
+}
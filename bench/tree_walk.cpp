@@ -0,0 +1,97 @@
+// The walks of the red-black tree that need no stack: find,
+// copy and teardown of a map built in ascending and in
+// random order, whose values have a destructor to run, with
+// the time per value and the stack each walk takes, which is measured by running it on a thread
+// whose stack is painted first. The Makefile builds this
+// driver at -O0 and -O2 as well, as tree_walk-O0 and
+// tree_walk-O2.
+#include "bench.hpp"
+#include "map.hpp"
+
+#include <cstring>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Map = sjtu::map<int, std::string>;
+
+constexpr size_t kStackSize = size_t(1) << 20;
+constexpr unsigned char kPaint = 0xa5;
+
+template <typename Fn>
+auto trampoline (void *fn) -> void * {
+  (*static_cast<Fn *>(fn))();
+  return nullptr;
+}
+
+/// Runs fn on a new thread, and returns how many bytes of its stack were touched.
+template <typename Fn>
+auto stackUsed (Fn fn) -> size_t {
+  static std::vector<unsigned char> stack(kStackSize);
+  std::memset(stack.data(), kPaint, kStackSize);
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstack(&attr, stack.data(), kStackSize);
+  pthread_t thread;
+  if (pthread_create(&thread, &attr, trampoline<Fn>, &fn) != 0) return 0;
+  pthread_join(thread, nullptr);
+  pthread_attr_destroy(&attr);
+  // the stack grows down, from the end of the buffer.
+  size_t untouched = 0;
+  while (untouched < kStackSize && stack[untouched] == kPaint) ++untouched;
+  return kStackSize - untouched;
+}
+
+auto run (const char *name, const std::vector<int> &keys) -> void {
+  size_t n = keys.size();
+  char label[64];
+  Map map;
+  for (int key : keys) map[key] = std::to_string(key);
+  double ms = bench::bestOf(5, [&] {
+    long sum = 0;
+    for (int key : keys) sum += static_cast<long>(map.find(key)->second.size());
+    bench::keep(sum);
+  });
+  std::snprintf(label, sizeof(label), "find/%s", name);
+  bench::report(label, n, ms, n);
+
+  double copy = 0, teardown = 0;
+  for (int rep = 0; rep < 5; ++rep) {
+    auto start = std::chrono::steady_clock::now();
+    auto *clone = new Map(map);
+    auto copied = std::chrono::steady_clock::now();
+    delete clone;
+    auto done = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> a = copied - start, b = done - copied;
+    if (rep == 0 || a.count() < copy) copy = a.count();
+    if (rep == 0 || b.count() < teardown) teardown = b.count();
+  }
+  std::snprintf(label, sizeof(label), "copy/%s", name);
+  bench::report(label, n, copy, n);
+  std::snprintf(label, sizeof(label), "teardown/%s", name);
+  bench::report(label, n, teardown, n);
+
+  Map *clone = nullptr;
+  size_t copyStack = stackUsed([&] { clone = new Map(map); });
+  size_t teardownStack = stackUsed([&] { delete clone; });
+  size_t findStack = stackUsed([&] {
+    long sum = 0;
+    for (int key : keys) sum += static_cast<long>(map.find(key)->second.size());
+    bench::keep(sum);
+  });
+  std::printf("%-40s find %zu, copy %zu, teardown %zu bytes of stack\n", name, findStack, copyStack, teardownStack);
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  size_t n = bench::sizeArg(argc, argv, 1, 1000000);
+  std::printf("%-40s %zu bytes of stack\n", "starting a thread", stackUsed([] {}));
+  std::vector<int> ascending;
+  for (size_t i = 0; i < n; ++i) ascending.push_back(static_cast<int>(i));
+  run("ascending", ascending);
+  run("random", bench::randomKeys<std::vector<int>>(n));
+  return 0;
+}
@@ -0,0 +1,67 @@
+// Loops over vector::operator[], under each access policy,
+// in the same program: the policy is part of the type.
+#include "bench.hpp"
+#include "vector.hpp"
+
+#include <cstdint>
+
+namespace {
+
+template <typename Access>
+using Vector = sjtu::vector<int, sjtu::doubling_growth, sjtu::allocator<int>, 0, Access>;
+
+auto name (const char *loop, const char *policy) -> const char * {
+  static char buffer[64];
+  std::snprintf(buffer, sizeof(buffer), "%s/%s", loop, policy);
+  return buffer;
+}
+
+template <typename Access>
+auto run (const char *policy, size_t n) -> void {
+  int reps = 50;
+  Vector<Access> x, y;
+  sjtu::vector<uint32_t, sjtu::doubling_growth, sjtu::allocator<uint32_t>, 0, Access> index;
+  std::mt19937 rng(1);
+  for (size_t i = 0; i < n; ++i) {
+    x.push_back(static_cast<int>(rng() % 1000));
+    y.push_back(static_cast<int>(rng() % 1000));
+    index.push_back(static_cast<uint32_t>(rng() % n));
+  }
+
+  double ms = bench::bestOf(reps, [&] {
+    int sum = 0;
+    for (size_t i = 0; i < n; ++i) sum += x[i];
+    bench::keep(sum);
+  });
+  bench::report(name("sum", policy), n, ms, n);
+
+  ms = bench::bestOf(reps, [&] {
+    for (size_t i = 0; i < n; ++i) y[i] += 3 * x[i];
+    bench::keep(y[0]);
+  });
+  bench::report(name("axpy", policy), n, ms, n);
+
+  // the indices of a stencil are not the loop counter, so a
+  // check cannot be proven redundant.
+  ms = bench::bestOf(reps, [&] {
+    for (size_t i = 1; i + 1 < n; ++i) y[i] = x[i - 1] + 2 * x[i] + x[i + 1];
+    bench::keep(y[1]);
+  });
+  bench::report(name("stencil", policy), n, ms, n);
+
+  ms = bench::bestOf(reps, [&] {
+    int sum = 0;
+    for (size_t i = 0; i < n; ++i) sum += x[index[i]];
+    bench::keep(sum);
+  });
+  bench::report(name("gather", policy), n, ms, n);
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  size_t n = bench::sizeArg(argc, argv, 1, size_t(1) << 20);
+  run<sjtu::checked_access>("checked", n);
+  run<sjtu::unchecked_access>("unchecked", n);
+  return 0;
+}
@@ -0,0 +1,922 @@
+#ifndef SJTU_BTREE_HPP_
+#define SJTU_BTREE_HPP_
+
+#include "utility.hpp"
+#include "exceptions.hpp"
+#include "memory.hpp"
+#include "vector.hpp"
+#include "type_traits.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+namespace panic {
+
+/**
+ * A B+-tree, allowing no duplicate keys. It is an
+ * alternative engine of sjtu::map to RbTree, with the same
+ * interface save for the order statistics, split and join.
+ *
+ * All the values live in the leaves, which are linked in
+ * order for iteration; inner nodes hold copies of the keys
+ * only, as separators. A node takes kNodeBytes, i.e. a few
+ * cache lines, so a lookup costs a few misses per level in
+ * a tree of log_B(n) levels, rather than one miss per level
+ * in a binary tree some 2 log_2(n) levels high.
+ *
+ * Child i of an inner node holds the keys in [key(i - 1),
+ * key(i)). Every node other than the root is at least half
+ * full; erasures borrow from or merge with a sibling.
+ *
+ * ValueType must be a pair whose first is the key, as in
+ * sjtu::map. Unlike those of RbTree, iterators are
+ * invalidated by insertions and erasures, as values move
+ * within and between nodes.
+ */
+template <
+  typename ValueType,
+  typename Cmp,
+  typename Alloc = sjtu::allocator<ValueType>,
+  size_t kNodeBytes = 256
+> class BPlusTree {
+ private:
+  using Key = std::remove_const_t<decltype(std::declval<ValueType &>().first)>;
+  class Node;
+  class Leaf;
+  class Inner;
+  static constexpr size_t kCacheLine_ = 64;
+  static constexpr size_t kMinCapacity_ = 4;
+  // the header is a word, plus the links of a leaf or the extra child of an inner node.
+  static constexpr size_t kLeafFit_ = (kNodeBytes - 3 * sizeof(void *)) / sizeof(ValueType);
+  static constexpr size_t kInnerFit_ = (kNodeBytes - 2 * sizeof(void *)) / (sizeof(Key) + sizeof(void *));
+  // values in a leaf.
+  static constexpr size_t kLeafCapacity_ = kLeafFit_ < kMinCapacity_ ? kMinCapacity_ : kLeafFit_;
+  // keys in an inner node, which has one more child.
+  static constexpr size_t kInnerCapacity_ = kInnerFit_ < kMinCapacity_ ? kMinCapacity_ : kInnerFit_;
+  static constexpr size_t kLeafMin_ = kLeafCapacity_ / 2;
+  static constexpr size_t kInnerMin_ = kInnerCapacity_ / 2;
+  // a bound on the height, as inner nodes have at least 2 children.
+  static constexpr size_t kMaxDepth_ = sizeof(size_t) * 8;
+ public:
+  using value_type = ValueType;
+  class const_iterator;
+  class iterator {
+   private:
+    Leaf *leaf_ = nullptr;
+    size_t index_ = 0;
+    BPlusTree *home_ = nullptr;
+    friend class BPlusTree;
+    friend class const_iterator;
+   public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = BPlusTree::value_type;
+    using pointer = value_type *;
+    using reference = value_type &;
+    using iterator_category = std::bidirectional_iterator_tag;
+
+    iterator () = default;
+    iterator (Leaf *leaf, size_t index, BPlusTree *home) : leaf_(leaf), index_(index), home_(home) {}
+    auto operator++ (int) -> iterator {
+      iterator retval = *this;
+      ++*this;
+      return retval;
+    }
+    auto operator++ () -> iterator & {
+      if (leaf_ == nullptr) throw sjtu::invalid_iterator();
+      if (++index_ == leaf_->size) {
+        leaf_ = leaf_->next;
+        index_ = 0;
+      }
+      return *this;
+    }
+    auto operator-- (int) -> iterator {
+      iterator retval = *this;
+      --*this;
+      return retval;
+    }
+    auto operator-- () -> iterator & {
+      home_->retreat_(leaf_, index_);
+      return *this;
+    }
+    auto operator* () const -> value_type & {
+      return *leaf_->slot(index_);
+    }
+    auto operator== (const iterator &rhs) const -> bool {
+      return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+    }
+    auto operator== (const const_iterator &rhs) const -> bool {
+      return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+    }
+    auto operator!= (const iterator &rhs) const -> bool {
+      return !(*this == rhs);
+    }
+    auto operator!= (const const_iterator &rhs) const -> bool {
+      return !(*this == rhs);
+    }
+
+    auto operator-> () const noexcept -> value_type * {
+      return leaf_->slot(index_);
+    }
+  };
+  class const_iterator {
+   private:
+    Leaf *leaf_ = nullptr;
+    size_t index_ = 0;
+    BPlusTree *home_ = nullptr;
+    friend class BPlusTree;
+    friend class iterator;
+   public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = const BPlusTree::value_type;
+    using pointer = value_type *;
+    using reference = value_type &;
+    using iterator_category = std::bidirectional_iterator_tag;
+
+    const_iterator () = default;
+    const_iterator (const Leaf *leaf, size_t index, const BPlusTree *home)
+      : leaf_(const_cast<Leaf *>(leaf)), index_(index), home_(const_cast<BPlusTree *>(home)) {}
+    const_iterator (const iterator &it) : leaf_(it.leaf_), index_(it.index_), home_(it.home_) {}
+    auto operator++ (int) -> const_iterator {
+      const_iterator retval = *this;
+      ++*this;
+      return retval;
+    }
+    auto operator++ () -> const_iterator & {
+      if (leaf_ == nullptr) throw sjtu::invalid_iterator();
+      if (++index_ == leaf_->size) {
+        leaf_ = leaf_->next;
+        index_ = 0;
+      }
+      return *this;
+    }
+    auto operator-- (int) -> const_iterator {
+      const_iterator retval = *this;
+      --*this;
+      return retval;
+    }
+    auto operator-- () -> const_iterator & {
+      home_->retreat_(leaf_, index_);
+      return *this;
+    }
+    auto operator* () const -> value_type & {
+      return *leaf_->slot(index_);
+    }
+    auto operator== (const const_iterator &rhs) const -> bool {
+      return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+    }
+    auto operator== (const iterator &rhs) const -> bool {
+      return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+    }
+    auto operator!= (const const_iterator &rhs) const -> bool {
+      return !(*this == rhs);
+    }
+    auto operator!= (const iterator &rhs) const -> bool {
+      return !(*this == rhs);
+    }
+
+    auto operator-> () const noexcept -> value_type * {
+      return leaf_->slot(index_);
+    }
+  };
+
+  BPlusTree () = default;
+  explicit BPlusTree (const Alloc &alloc) : leafAlloc_(alloc), innerAlloc_(alloc) {}
+  /**
+   * Builds the tree from the values in [first, last),
+   * keeping the first of equivalent values. Sorted input
+   * without duplicates is loaded into packed leaves in O(n).
+   */
+  template <typename InputIt>
+  BPlusTree (InputIt first, InputIt last, const Alloc &alloc = Alloc())
+    : leafAlloc_(alloc), innerAlloc_(alloc) {
+    using Category = typename std::iterator_traits<InputIt>::iterator_category;
+    if constexpr (std::is_base_of_v<std::forward_iterator_tag, Category>) {
+      if (isSortedUnique_(first, last)) {
+        build_(first, std::distance(first, last));
+        return;
+      }
+    }
+    try {
+      for (; first != last; ++first) insert(*first);
+    } catch (...) {
+      destroy_();
+      throw;
+    }
+  }
+  BPlusTree (const BPlusTree &other)
+    : BPlusTree(std::allocator_traits<Alloc>::select_on_container_copy_construction(other.get_allocator())) {
+    build_(other.cbegin(), other.size_);
+  }
+  ~BPlusTree () { destroy_(); }
+
+  auto operator= (const BPlusTree &other) -> BPlusTree & {
+    if (this == &other) return *this;
+    destroy_();
+    build_(other.cbegin(), other.size_);
+    return *this;
+  }
+  auto get_allocator () const -> Alloc {
+    return Alloc(leafAlloc_);
+  }
+  auto begin () -> iterator {
+    return iterator(first_, 0, this);
+  }
+  auto cbegin () const -> const_iterator {
+    return const_iterator(first_, 0, this);
+  }
+  auto end () -> iterator {
+    return iterator(nullptr, 0, this);
+  }
+  auto cend () const -> const_iterator {
+    return const_iterator(nullptr, 0, this);
+  }
+  auto empty () const -> bool {
+    return size_ == 0;
+  }
+  auto size () const -> size_t {
+    return size_;
+  }
+  auto clear () -> void {
+    destroy_();
+  }
+  auto insert (const value_type &value) -> sjtu::pair<iterator, bool> {
+    return try_emplace(value.first, value);
+  }
+  /**
+   * Inserts a value constructed from args if there is no
+   * value with key, which must be the key of that value.
+   * Nothing is constructed otherwise.
+   */
+  template <typename ...Args>
+  auto try_emplace (const Key &key, Args &&...args) -> sjtu::pair<iterator, bool> {
+    if (root_ == nullptr) {
+      Leaf *leaf = sjtu::internal::newObject<Leaf>(leafAlloc_);
+      try {
+        new(leaf->slot(0)) ValueType(std::forward<Args>(args)...);
+      } catch (...) {
+        sjtu::internal::deleteObject(leafAlloc_, leaf);
+        throw;
+      }
+      leaf->size = 1;
+      root_ = first_ = last_ = leaf;
+      size_ = 1;
+      return sjtu::pair(iterator(leaf, 0, this), true);
+    }
+    Path path;
+    Leaf *leaf = descend_(key, path);
+    size_t index = lowerBound_(leaf, key);
+    if (index < leaf->size && !Cmp()(key, *leaf->slot(index))) {
+      return sjtu::pair(iterator(leaf, index, this), false);
+    }
+    iterator pos = leaf->size < kLeafCapacity_
+      ? insertInto_(leaf, index, std::forward<Args>(args)...)
+      : splitInsert_(path, leaf, index, key, std::forward<Args>(args)...);
+    ++size_;
+    return sjtu::pair(pos, true);
+  }
+  /// The hint is only checked; a lookup takes O(log n) anyway.
+  auto insert (const_iterator hint, const value_type &value) -> iterator {
+    if (hint.home_ != this) throw sjtu::invalid_iterator();
+    return insert(value).first;
+  }
+  /**
+   * Constructs the value from args, and moves it into a
+   * leaf if its key is new: values are relocated between
+   * leaves, so there is no node to construct it in first.
+   */
+  template <typename ...Args>
+  auto emplace_hint (const_iterator hint, Args &&...args) -> iterator {
+    if (hint.home_ != this) throw sjtu::invalid_iterator();
+    ValueType value(std::forward<Args>(args)...);
+    return try_emplace(value.first, std::move(value)).first;
+  }
+  auto erase (iterator pos) -> void {
+    if (pos.leaf_ == nullptr || pos.home_ != this) throw sjtu::invalid_iterator();
+    Leaf *leaf = pos.leaf_;
+    Path path;
+    if (leaf != root_) descend_(leaf->slot(pos.index_)->first, path);
+    leaf->slot(pos.index_)->~ValueType();
+    sjtu::relocate(leaf->slot(pos.index_), leaf->slot(pos.index_ + 1), leaf->size - pos.index_ - 1);
+    --leaf->size;
+    --size_;
+    if (leaf == root_) {
+      if (leaf->size == 0) {
+        sjtu::internal::deleteObject(leafAlloc_, leaf);
+        root_ = first_ = last_ = nullptr;
+      }
+      return;
+    }
+    if (leaf->size < kLeafMin_) rebalance_(path);
+  }
+  /**
+   * Erases the values in [first, last), one by one, in
+   * O(k log n) for k values, and returns an iterator to the
+   * value after them. As erasures move values around, the
+   * next value to erase is looked up by key every time.
+   */
+  auto erase (const_iterator first, const_iterator last) -> iterator {
+    if (first.home_ != this || last.home_ != this) throw sjtu::invalid_iterator();
+    if (first == last) return iterator(last.leaf_, last.index_, this);
+    size_t count = 0;
+    for (const_iterator it = first; it != last; ++it) ++count;
+    Key key(first->first);
+    for (; count > 0; --count) erase(lower_bound(key));
+    return lower_bound(key);
+  }
+  /**
+   * Erases the values for which pred returns true, and
+   * returns how many, in O(n + k log n) for k values.
+   */
+  template <typename Pred>
+  auto erase_if (Pred pred) -> size_t {
+    size_t count = 0;
+    for (iterator it = begin(); it != end();) {
+      if (!pred(static_cast<const ValueType &>(*it))) {
+        ++it;
+        continue;
+      }
+      Key key(it->first);
+      erase(it);
+      ++count;
+      it = lower_bound(key);
+    }
+    return count;
+  }
+  template <typename K>
+  auto find (const K &key) -> iterator {
+    auto [ leaf, index ] = find_(key);
+    return iterator(leaf, index, this);
+  }
+  template <typename K>
+  auto find (const K &key) const -> const_iterator {
+    auto [ leaf, index ] = find_(key);
+    return const_iterator(leaf, index, this);
+  }
+  /// The first element not less than key, or end().
+  template <typename K>
+  auto lower_bound (const K &key) -> iterator {
+    auto [ leaf, index ] = bound_<false>(key);
+    return iterator(leaf, index, this);
+  }
+  template <typename K>
+  auto lower_bound (const K &key) const -> const_iterator {
+    auto [ leaf, index ] = bound_<false>(key);
+    return const_iterator(leaf, index, this);
+  }
+  /// The first element greater than key, or end().
+  template <typename K>
+  auto upper_bound (const K &key) -> iterator {
+    auto [ leaf, index ] = bound_<true>(key);
+    return iterator(leaf, index, this);
+  }
+  template <typename K>
+  auto upper_bound (const K &key) const -> const_iterator {
+    auto [ leaf, index ] = bound_<true>(key);
+    return const_iterator(leaf, index, this);
+  }
+  /// The range of elements equivalent to key.
+  template <typename K>
+  auto equal_range (const K &key) -> sjtu::pair<iterator, iterator> {
+    return sjtu::pair(lower_bound(key), upper_bound(key));
+  }
+  template <typename K>
+  auto equal_range (const K &key) const -> sjtu::pair<const_iterator, const_iterator> {
+    return sjtu::pair(lower_bound(key), upper_bound(key));
+  }
+  /**
+   * Checks the order, fill, depth and links of the nodes
+   * and the size in O(n), for tests.
+   */
+  auto valid () const -> bool {
+    if (root_ == nullptr) return first_ == nullptr && last_ == nullptr && size_ == 0;
+    size_t depth = 0;
+    size_t count = 0;
+    Leaf *prev = nullptr;
+    if (!validNode_(root_, nullptr, nullptr, 0, depth, count, prev)) return false;
+    return prev == last_ && last_->next == nullptr && count == size_;
+  }
+
+ private:
+  class alignas(kCacheLine_) Node {
+   public:
+    explicit Node (bool isLeaf) : isLeaf(isLeaf) {}
+    // values in a leaf, or keys in an inner node.
+    std::uint32_t size = 0;
+    bool isLeaf;
+  };
+  class Leaf : public Node {
+   public:
+    Leaf () : Node(true) {}
+    Leaf *prev = nullptr;
+    Leaf *next = nullptr;
+    auto slot (size_t i) -> ValueType * {
+      return std::launder(reinterpret_cast<ValueType *>(values_)) + i;
+    }
+   private:
+    alignas(ValueType) char values_[kLeafCapacity_ * sizeof(ValueType)];
+  };
+  class Inner : public Node {
+   public:
+    Inner () : Node(false) {}
+    Node *children[kInnerCapacity_ + 1];
+    auto slot (size_t i) -> Key * {
+      return std::launder(reinterpret_cast<Key *>(keys_)) + i;
+    }
+   private:
+    alignas(Key) char keys_[kInnerCapacity_ * sizeof(Key)];
+  };
+  /// The inner nodes on the way down to a leaf, and the child taken in each.
+  struct Path {
+    Inner *nodes[kMaxDepth_];
+    size_t children[kMaxDepth_];
+    size_t depth = 0;
+  };
+  using LeafAlloc_ = typename std::allocator_traits<Alloc>::template rebind_alloc<Leaf>;
+  using InnerAlloc_ = typename std::allocator_traits<Alloc>::template rebind_alloc<Inner>;
+
+  Node *root_ = nullptr;
+  // the ends of the list of leaves.
+  Leaf *first_ = nullptr;
+  Leaf *last_ = nullptr;
+  size_t size_ = 0;
+  [[no_unique_address]] LeafAlloc_ leafAlloc_;
+  [[no_unique_address]] InnerAlloc_ innerAlloc_;
+
+  /// Moves (leaf, index) one element back, for the iterators.
+  auto retreat_ (Leaf *&leaf, size_t &index) const -> void {
+    if (leaf == nullptr) {
+      if (last_ == nullptr) throw sjtu::invalid_iterator();
+      leaf = last_;
+      index = leaf->size;
+    } else if (index == 0) {
+      if (leaf->prev == nullptr) throw sjtu::invalid_iterator();
+      leaf = leaf->prev;
+      index = leaf->size;
+    }
+    --index;
+  }
+
+  /// The child of node to descend into for key: the number of keys not greater than key.
+  template <typename K>
+  static auto childIndex_ (Inner *node, const K &key) -> size_t {
+    Cmp cmp;
+    size_t lo = 0;
+    size_t hi = node->size;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (cmp(key, *node->slot(mid))) {
+        hi = mid;
+      } else {
+        lo = mid + 1;
+      }
+    }
+    return lo;
+  }
+  /// The first value in leaf not less than key, or greater if kUpper.
+  template <bool kUpper = false, typename K>
+  static auto lowerBound_ (Leaf *leaf, const K &key) -> size_t {
+    Cmp cmp;
+    size_t lo = 0;
+    size_t hi = leaf->size;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      bool right = kUpper ? !cmp(key, *leaf->slot(mid)) : cmp(*leaf->slot(mid), key);
+      if (right) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+  /// Finds the leaf where key belongs, recording the way.
+  template <typename K>
+  auto descend_ (const K &key, Path &path) const -> Leaf * {
+    Node *node = root_;
+    while (!node->isLeaf) {
+      auto *inner = static_cast<Inner *>(node);
+      size_t child = childIndex_(inner, key);
+      path.nodes[path.depth] = inner;
+      path.children[path.depth] = child;
+      ++path.depth;
+      node = inner->children[child];
+    }
+    return static_cast<Leaf *>(node);
+  }
+  template <typename K>
+  auto find_ (const K &key) const -> sjtu::pair<Leaf *, size_t> {
+    auto [ leaf, index ] = bound_<false>(key);
+    if (leaf == nullptr || Cmp()(key, *leaf->slot(index))) return sjtu::pair<Leaf *, size_t>(nullptr, 0);
+    return sjtu::pair(leaf, index);
+  }
+  template <bool kUpper, typename K>
+  auto bound_ (const K &key) const -> sjtu::pair<Leaf *, size_t> {
+    if (root_ == nullptr) return sjtu::pair<Leaf *, size_t>(nullptr, 0);
+    Path path;
+    Leaf *leaf = descend_(key, path);
+    size_t index = lowerBound_<kUpper>(leaf, key);
+    // all of the leaf is before key; the bound starts the next one.
+    if (index == leaf->size) return sjtu::pair<Leaf *, size_t>(leaf->next, 0);
+    return sjtu::pair(leaf, index);
+  }
+
+  /// Inserts a value made from args at index of a leaf that has room.
+  template <typename ...Args>
+  auto insertInto_ (Leaf *leaf, size_t index, Args &&...args) -> iterator {
+    sjtu::relocate(leaf->slot(index + 1), leaf->slot(index), leaf->size - index);
+    try {
+      new(leaf->slot(index)) ValueType(std::forward<Args>(args)...);
+    } catch (...) {
+      sjtu::relocate(leaf->slot(index), leaf->slot(index + 1), leaf->size - index);
+      throw;
+    }
+    ++leaf->size;
+    return iterator(leaf, index, this);
+  }
+  /**
+   * Inserts a value with key, made from args, at index of a
+   * full leaf, splitting it and as many of its ancestors as
+   * needed. The new nodes and the separator are made first,
+   * so that a failure leaves the tree intact; if the value
+   * itself fails to construct, the tree is valid without it.
+   */
+  template <typename ...Args>
+  auto splitInsert_ (Path &path, Leaf *leaf, size_t index, const Key &key, Args &&...args) -> iterator {
+    size_t full = 0;
+    while (full < path.depth && path.nodes[path.depth - 1 - full]->size == kInnerCapacity_) ++full;
+    // one inner node per split ancestor, and a new root if all split.
+    size_t innerCount = full + (full == path.depth ? 1 : 0);
+    Inner *inners[kMaxDepth_ + 1];
+    size_t made = 0;
+    Leaf *right = nullptr;
+    // the left half keeps kept values, the new one included.
+    size_t kept = (kLeafCapacity_ + 1) / 2;
+    alignas(Key) char separator[sizeof(Key)];
+    try {
+      right = sjtu::internal::newObject<Leaf>(leafAlloc_);
+      for (; made < innerCount; ++made) inners[made] = sjtu::internal::newObject<Inner>(innerAlloc_);
+      const Key &first = index == kept
+        ? key
+        : leaf->slot(index < kept ? kept - 1 : kept)->first;
+      new(separator) Key(first);
+    } catch (...) {
+      if (right != nullptr) sjtu::internal::deleteObject(leafAlloc_, right);
+      for (size_t i = 0; i < made; ++i) sjtu::internal::deleteObject(innerAlloc_, inners[i]);
+      throw;
+    }
+    // split the leaf, leaving a gap for the value.
+    bool toLeft = index < kept;
+    size_t moved = toLeft ? kLeafCapacity_ - kept + 1 : kLeafCapacity_ - kept;
+    sjtu::relocate(right->slot(0), leaf->slot(kLeafCapacity_ - moved), moved);
+    right->size = moved;
+    leaf->size = kLeafCapacity_ - moved;
+    right->next = leaf->next;
+    right->prev = leaf;
+    if (leaf->next != nullptr) leaf->next->prev = right;
+    leaf->next = right;
+    if (last_ == leaf) last_ = right;
+    pushUp_(path, leaf, right, reinterpret_cast<Key *>(separator), inners);
+    Leaf *target = toLeft ? leaf : right;
+    return insertInto_(target, toLeft ? index : index - kept, std::forward<Args>(args)...);
+  }
+  /**
+   * Puts separator, which is relocated, and the new right
+   * sibling of node into the parent, splitting full
+   * ancestors with the nodes prepared in spares, from the
+   * bottom up.
+   */
+  auto pushUp_ (Path &path, Node *node, Node *right, Key *separator, Inner **spares) -> void {
+    alignas(Key) char middle[sizeof(Key)];
+    while (path.depth > 0) {
+      --path.depth;
+      Inner *parent = path.nodes[path.depth];
+      size_t child = path.children[path.depth];
+      if (parent->size < kInnerCapacity_) {
+        insertKey_(parent, child, separator, right);
+        return;
+      }
+      Inner *sibling = *spares++;
+      insertKeyOverflow_(parent, child, separator, right, sibling, reinterpret_cast<Key *>(middle));
+      sjtu::relocate(separator, reinterpret_cast<Key *>(middle), 1);
+      node = parent;
+      right = sibling;
+    }
+    Inner *root = *spares;
+    sjtu::relocate(root->slot(0), separator, 1);
+    root->children[0] = node;
+    root->children[1] = right;
+    root->size = 1;
+    root_ = root;
+  }
+  /// Relocates key into position index of an inner node with room, followed by child.
+  static auto insertKey_ (Inner *node, size_t index, Key *key, Node *child) -> void {
+    sjtu::relocate(node->slot(index + 1), node->slot(index), node->size - index);
+    sjtu::relocate(node->slot(index), key, 1);
+    for (size_t i = node->size + 1; i > index + 1; --i) node->children[i] = node->children[i - 1];
+    node->children[index + 1] = child;
+    ++node->size;
+  }
+  /**
+   * Like insertKey_, but into a full node. Of the keys with
+   * the new one in place, the upper half moves to sibling,
+   * and the one in the middle is relocated to middle.
+   */
+  static auto insertKeyOverflow_ (Inner *node, size_t index, Key *key, Node *child, Inner *sibling, Key *middle) -> void {
+    constexpr size_t kTotal = kInnerCapacity_ + 1;
+    // keys [0, kKept) stay, key kKept goes up, the rest go to sibling.
+    constexpr size_t kKept = kTotal / 2;
+    // the i-th key and j-th child, as if the new ones were in place.
+    auto logical = [&] (size_t i) -> Key * {
+      if (i < index) return node->slot(i);
+      if (i == index) return key;
+      return node->slot(i - 1);
+    };
+    // the children with the new one in place, all kTotal + 1 of them.
+    Node *children[kInnerCapacity_ + 2];
+    size_t count = 0;
+    for (size_t j = 0; j <= kInnerCapacity_; ++j) {
+      children[count++] = node->children[j];
+      if (j == index) children[count++] = child;
+    }
+    size_t moved = kTotal - kKept - 1;
+    for (size_t i = 0; i < moved; ++i) sjtu::relocate(sibling->slot(i), logical(kKept + 1 + i), 1);
+    for (size_t j = 0; j <= moved; ++j) sibling->children[j] = children[kKept + 1 + j];
+    sibling->size = moved;
+    sjtu::relocate(middle, logical(kKept), 1);
+    if (index < kKept) {
+      // the new key stays, in a gap in the kept keys.
+      sjtu::relocate(node->slot(index + 1), node->slot(index), kKept - 1 - index);
+      sjtu::relocate(node->slot(index), key, 1);
+    }
+    for (size_t j = 0; j <= kKept; ++j) node->children[j] = children[j];
+    node->size = kKept;
+  }
+
+  /**
+   * Restores the minimal fill of the node at the end of
+   * path, by borrowing from or merging with a sibling, and
+   * goes up as long as merges leave the parent underfull.
+   */
+  auto rebalance_ (Path &path) -> void {
+    while (path.depth > 0) {
+      --path.depth;
+      Inner *parent = path.nodes[path.depth];
+      size_t child = path.children[path.depth];
+      Node *node = parent->children[child];
+      bool isLeaf = node->isLeaf;
+      size_t min = isLeaf ? kLeafMin_ : kInnerMin_;
+      Node *left = child > 0 ? parent->children[child - 1] : nullptr;
+      Node *right = child < parent->size ? parent->children[child + 1] : nullptr;
+      if (left != nullptr && left->size > min) {
+        if (isLeaf) {
+          borrowLeaf_(parent, child - 1, static_cast<Leaf *>(left), static_cast<Leaf *>(node), true);
+        } else {
+          borrowInner_(parent, child - 1, static_cast<Inner *>(left), static_cast<Inner *>(node), true);
+        }
+        return;
+      }
+      if (right != nullptr && right->size > min) {
+        if (isLeaf) {
+          borrowLeaf_(parent, child, static_cast<Leaf *>(node), static_cast<Leaf *>(right), false);
+        } else {
+          borrowInner_(parent, child, static_cast<Inner *>(node), static_cast<Inner *>(right), false);
+        }
+        return;
+      }
+      size_t at = left != nullptr ? child - 1 : child;
+      if (isLeaf) {
+        mergeLeaves_(parent, at);
+      } else {
+        mergeInners_(parent, at);
+      }
+      if (parent == root_) {
+        if (parent->size == 0) {
+          root_ = parent->children[0];
+          sjtu::internal::deleteObject(innerAlloc_, parent);
+        }
+        return;
+      }
+      if (parent->size >= kInnerMin_) return;
+    }
+  }
+  /**
+   * Moves one value across the separator at index between
+   * the adjacent leaves, to right if toRight, or to left.
+   */
+  static auto borrowLeaf_ (Inner *parent, size_t index, Leaf *left, Leaf *right, bool toRight) -> void {
+    if (toRight) {
+      sjtu::relocate(right->slot(1), right->slot(0), right->size);
+      sjtu::relocate(right->slot(0), left->slot(left->size - 1), 1);
+      --left->size;
+      ++right->size;
+    } else {
+      sjtu::relocate(left->slot(left->size), right->slot(0), 1);
+      sjtu::relocate(right->slot(0), right->slot(1), right->size - 1);
+      ++left->size;
+      --right->size;
+    }
+    *parent->slot(index) = right->slot(0)->first;
+  }
+  /// Rotates one key and child through the separator at index.
+  static auto borrowInner_ (Inner *parent, size_t index, Inner *left, Inner *right, bool toRight) -> void {
+    if (toRight) {
+      sjtu::relocate(right->slot(1), right->slot(0), right->size);
+      for (size_t i = right->size + 1; i > 0; --i) right->children[i] = right->children[i - 1];
+      sjtu::relocate(right->slot(0), parent->slot(index), 1);
+      right->children[0] = left->children[left->size];
+      sjtu::relocate(parent->slot(index), left->slot(left->size - 1), 1);
+      --left->size;
+      ++right->size;
+    } else {
+      sjtu::relocate(left->slot(left->size), parent->slot(index), 1);
+      left->children[left->size + 1] = right->children[0];
+      sjtu::relocate(parent->slot(index), right->slot(0), 1);
+      sjtu::relocate(right->slot(0), right->slot(1), right->size - 1);
+      for (size_t i = 0; i < right->size; ++i) right->children[i] = right->children[i + 1];
+      ++left->size;
+      --right->size;
+    }
+  }
+  /// Closes the gap of the key at index, already gone, and drops the child after it.
+  static auto removeKey_ (Inner *node, size_t index) -> void {
+    sjtu::relocate(node->slot(index), node->slot(index + 1), node->size - index - 1);
+    for (size_t i = index + 1; i < node->size; ++i) node->children[i] = node->children[i + 1];
+    --node->size;
+  }
+  /// Merges the children at index and index + 1 of parent.
+  auto mergeLeaves_ (Inner *parent, size_t index) -> void {
+    auto *left = static_cast<Leaf *>(parent->children[index]);
+    auto *right = static_cast<Leaf *>(parent->children[index + 1]);
+    sjtu::relocate(left->slot(left->size), right->slot(0), right->size);
+    left->size += right->size;
+    left->next = right->next;
+    if (right->next != nullptr) right->next->prev = left;
+    if (last_ == right) last_ = left;
+    parent->slot(index)->~Key();
+    removeKey_(parent, index);
+    sjtu::internal::deleteObject(leafAlloc_, right);
+  }
+  auto mergeInners_ (Inner *parent, size_t index) -> void {
+    auto *left = static_cast<Inner *>(parent->children[index]);
+    auto *right = static_cast<Inner *>(parent->children[index + 1]);
+    sjtu::relocate(left->slot(left->size), parent->slot(index), 1);
+    sjtu::relocate(left->slot(left->size + 1), right->slot(0), right->size);
+    for (size_t i = 0; i <= right->size; ++i) left->children[left->size + 1 + i] = right->children[i];
+    left->size += 1 + right->size;
+    removeKey_(parent, index);
+    sjtu::internal::deleteObject(innerAlloc_, right);
+  }
+
+  template <typename InputIt>
+  static auto isSortedUnique_ (InputIt first, InputIt last) -> bool {
+    if (first == last) return true;
+    Cmp cmp;
+    InputIt prev = first;
+    for (++first; first != last; ++first, ++prev) {
+      if (!cmp((*prev).first, (*first).first)) return false;
+    }
+    return true;
+  }
+  /**
+   * Checks the subtree under node at level, whose keys must
+   * lie in [lo, hi) where not null. The leaves must all be
+   * at the same depth and follow prev in the list; count
+   * adds up their values.
+   */
+  auto validNode_ (Node *node, const Key *lo, const Key *hi, size_t level, size_t &depth, size_t &count, Leaf *&prev) const -> bool {
+    Cmp cmp;
+    if (node != root_ && node->size < (node->isLeaf ? kLeafMin_ : kInnerMin_)) return false;
+    if (node->isLeaf) {
+      auto *leaf = static_cast<Leaf *>(node);
+      if (leaf->size == 0 || leaf->size > kLeafCapacity_) return false;
+      if (depth == 0) depth = level + 1;
+      if (depth != level + 1) return false;
+      if (leaf->prev != prev || (prev == nullptr ? first_ != leaf : prev->next != leaf)) return false;
+      prev = leaf;
+      count += leaf->size;
+      for (size_t i = 0; i < leaf->size; ++i) {
+        const ValueType &value = *leaf->slot(i);
+        if (i > 0 && !cmp(*leaf->slot(i - 1), value)) return false;
+        if ((lo != nullptr && cmp(value, *lo)) || (hi != nullptr && !cmp(value, *hi))) return false;
+      }
+      return true;
+    }
+    auto *inner = static_cast<Inner *>(node);
+    if (inner->size == 0 || inner->size > kInnerCapacity_) return false;
+    for (size_t i = 0; i <= inner->size; ++i) {
+      const Key *left = i == 0 ? lo : inner->slot(i - 1);
+      const Key *right = i == inner->size ? hi : inner->slot(i);
+      if (left != nullptr && right != nullptr && !cmp(*left, *right)) return false;
+      if (!validNode_(inner->children[i], left, right, level + 1, depth, count, prev)) return false;
+    }
+    return true;
+  }
+  /// The smallest key under node.
+  static auto minKey_ (Node *node) -> const Key & {
+    while (!node->isLeaf) node = static_cast<Inner *>(node)->children[0];
+    return static_cast<Leaf *>(node)->slot(0)->first;
+  }
+  /**
+   * Fills an empty tree with n sorted unique values from
+   * first, in evenly packed leaves, and then builds the
+   * inner levels bottom up the same way.
+   */
+  template <typename InputIt>
+  auto build_ (InputIt first, size_t n) -> void {
+    if (n == 0) return;
+    sjtu::vector<Node *> level;
+    sjtu::vector<Inner *> inners;
+    try {
+      size_t leaves = (n + kLeafCapacity_ - 1) / kLeafCapacity_;
+      level.reserve(leaves);
+      for (size_t i = 0; i < leaves; ++i) {
+        Leaf *leaf = sjtu::internal::newObject<Leaf>(leafAlloc_);
+        leaf->prev = last_;
+        if (last_ != nullptr) {
+          last_->next = leaf;
+        } else {
+          first_ = leaf;
+        }
+        last_ = leaf;
+        level.push_back(leaf);
+        size_t count = n / leaves + (i < n % leaves ? 1 : 0);
+        for (; leaf->size < count; ++leaf->size, ++first) new(leaf->slot(leaf->size)) ValueType(*first);
+        size_ += count;
+      }
+      while (level.size() > 1) {
+        size_t count = level.size();
+        size_t parents = (count + kInnerCapacity_) / (kInnerCapacity_ + 1);
+        sjtu::vector<Node *> upper;
+        upper.reserve(parents);
+        size_t next = 0;
+        for (size_t i = 0; i < parents; ++i) {
+          inners.push_back(nullptr);
+          Inner *inner = sjtu::internal::newObject<Inner>(innerAlloc_);
+          inners[inners.size() - 1] = inner;
+          upper.push_back(inner);
+          size_t children = count / parents + (i < count % parents ? 1 : 0);
+          inner->children[0] = level[next++];
+          for (size_t j = 1; j < children; ++j, ++inner->size) {
+            new(inner->slot(inner->size)) Key(minKey_(level[next]));
+            inner->children[j] = level[next++];
+          }
+        }
+        level = upper;
+      }
+      root_ = level[0];
+    } catch (...) {
+      for (Inner *inner : inners) {
+        if (inner == nullptr) continue;
+        for (size_t i = 0; i < inner->size; ++i) inner->slot(i)->~Key();
+        sjtu::internal::deleteObject(innerAlloc_, inner);
+      }
+      root_ = nullptr;
+      destroyLeaves_();
+      throw;
+    }
+  }
+  /// Destructs the values of, and frees, all the leaves.
+  auto destroyLeaves_ () noexcept -> void {
+    for (Leaf *leaf = first_; leaf != nullptr;) {
+      Leaf *next = leaf->next;
+      if constexpr (!std::is_trivially_destructible_v<ValueType>) {
+        for (size_t i = 0; i < leaf->size; ++i) leaf->slot(i)->~ValueType();
+      }
+      sjtu::internal::deleteObject(leafAlloc_, leaf);
+      leaf = next;
+    }
+    first_ = last_ = nullptr;
+    size_ = 0;
+  }
+  /// Destructs the keys of, and frees, the inner nodes under node.
+  auto destroyInners_ (Node *node) noexcept -> void {
+    if (node->isLeaf) return;
+    auto *inner = static_cast<Inner *>(node);
+    for (size_t i = 0; i <= inner->size; ++i) destroyInners_(inner->children[i]);
+    if constexpr (!std::is_trivially_destructible_v<Key>) {
+      for (size_t i = 0; i < inner->size; ++i) inner->slot(i)->~Key();
+    }
+    sjtu::internal::deleteObject(innerAlloc_, inner);
+  }
+  auto destroy_ () noexcept -> void {
+    if (root_ != nullptr) destroyInners_(root_);
+    root_ = nullptr;
+    destroyLeaves_();
+  }
+};
+
+/// Selects BPlusTree, with nodes of kNodeBytes, as the engine of sjtu::map.
+template <size_t kNodeBytes = 256>
+class BTreeEngine {
+ public:
+  template <typename ValueType, typename Cmp, typename Alloc>
+  using type = BPlusTree<ValueType, Cmp, Alloc, kNodeBytes>;
+};
+
+} // namespace panic
+
+#endif // SJTU_BTREE_HPP_
@@ -0,0 +1,201 @@
+#ifndef SJTU_CONCURRENT_MAP_HPP_
+#define SJTU_CONCURRENT_MAP_HPP_
+
+#include "utility.hpp"
+#include "exceptions.hpp"
+#include "memory.hpp"
+#include "persistent_map.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace sjtu {
+
+/**
+ * An ordered map for many reader threads and occasional
+ * writers, in which readers never block.
+ *
+ * The map is a persistent_map published through an atomic
+ * pointer. A writer, under a mutex that only writers take,
+ * copies the current version in O(1), applies its writes
+ * to the copy, which copies the O(log n) nodes they change,
+ * and publishes it, so readers see either all of an update
+ * or none of it. Published nodes are never changed.
+ *
+ * An old version is freed once no reader may still be
+ * reading it, by epoch-based reclamation: a reader counts
+ * itself in, under the current epoch, for as long as it
+ * looks at a version; after publishing, the writer bumps
+ * the epoch and waits for the readers counted under the
+ * previous one to leave. The counters are spread over
+ * cache lines, so that readers on different cores seldom
+ * write to the same one.
+ *
+ * Reads return copies of the mapped values, as a version
+ * may be freed right after a read; snapshot() returns a
+ * whole version to keep, for consistent reads of several
+ * elements.
+ */
+template <
+  typename KeyType,
+  typename ValueType,
+  typename Compare = std::less<KeyType>,
+  typename Allocator = allocator<pair<const KeyType, ValueType>>
+> class concurrent_map {
+ public:
+  using value_type = pair<const KeyType, ValueType>;
+  using snapshot_type = persistent_map<KeyType, ValueType, Compare, Allocator>;
+
+  concurrent_map () : concurrent_map(Allocator()) {}
+  explicit concurrent_map (const Allocator &alloc) : alloc_(alloc) {
+    current_.store(sjtu::internal::newObject<snapshot_type>(alloc_, alloc));
+  }
+  concurrent_map (const concurrent_map &other) = delete;
+  auto operator= (const concurrent_map &other) -> concurrent_map & = delete;
+  ~concurrent_map () {
+    sjtu::internal::deleteObject(alloc_, current_.load());
+  }
+  auto get_allocator () const -> Allocator {
+    return Allocator(alloc_);
+  }
+
+  /**
+   * Runs fn on the current version, as a const
+   * snapshot_type &, and returns what it returns. fn must
+   * not keep references into the version after it returns.
+   */
+  template <typename Fn>
+  auto read (Fn &&fn) const -> decltype(std::forward<Fn>(fn)(std::declval<const snapshot_type &>())) {
+    ReadGuard_ guard(*this);
+    return std::forward<Fn>(fn)(static_cast<const snapshot_type &>(*current_.load()));
+  }
+  /// Returns the current version, which later updates leave as it is.
+  auto snapshot () const -> snapshot_type {
+    return read([] (const snapshot_type &version) { return version; });
+  }
+  /**
+   * Returns a copy of the value mapped to key.
+   * throw index_out_of_bound if such key does not exist.
+   */
+  auto at (const KeyType &key) const -> ValueType {
+    return read([&] (const snapshot_type &version) { return version.at(key); });
+  }
+  auto count (const KeyType &key) const -> size_t {
+    return read([&] (const snapshot_type &version) { return version.count(key); });
+  }
+  auto empty () const -> bool {
+    return read([] (const snapshot_type &version) { return version.empty(); });
+  }
+  auto size () const -> size_t {
+    return read([] (const snapshot_type &version) { return version.size(); });
+  }
+
+  /**
+   * Runs fn on a copy of the current version, as a
+   * snapshot_type &, and publishes the copy, so that the
+   * writes of fn appear all at once. If fn throws, nothing
+   * is published. Updates are serialized.
+   */
+  template <typename Fn>
+  auto update (Fn &&fn) -> void {
+    std::lock_guard<std::mutex> lock(writeLock_);
+    snapshot_type *old = current_.load();
+    snapshot_type *next = sjtu::internal::newObject<snapshot_type>(alloc_, *old);
+    try {
+      std::forward<Fn>(fn)(*next);
+    } catch (...) {
+      sjtu::internal::deleteObject(alloc_, next);
+      throw;
+    }
+    current_.store(next);
+    synchronize_();
+    sjtu::internal::deleteObject(alloc_, old);
+  }
+  /**
+   * insert an element.
+   * return true if insert successfully, or false if an
+   *   element with an equivalent key is already there.
+   */
+  auto insert (const value_type &value) -> bool {
+    bool inserted = false;
+    update([&] (snapshot_type &version) { inserted = version.insert(value).second; });
+    return inserted;
+  }
+  /**
+   * Erases the element with key equivalent to key, if any.
+   * return the number of elements erased, 1 or 0.
+   */
+  auto erase (const KeyType &key) -> size_t {
+    size_t erased = 0;
+    update([&] (snapshot_type &version) { erased = version.erase(key); });
+    return erased;
+  }
+
+ private:
+  using SnapshotAlloc_ = typename std::allocator_traits<Allocator>::template rebind_alloc<snapshot_type>;
+  static constexpr size_t kCacheLine_ = 64;
+  static constexpr size_t kShards_ = 32;
+  class alignas(kCacheLine_) Counter_ {
+   public:
+    std::atomic<size_t> readers { 0 };
+  };
+
+  /**
+   * Counts a reader in under the current epoch, for its
+   * lifetime. All the accesses to epoch_, the counters and
+   * current_ are sequentially consistent: a reader that
+   * finds the epoch unchanged after counting itself in was
+   * counted before the next bump, so the writer waits for
+   * it, and any reader counted in after the bump sees the
+   * version published before it.
+   */
+  class ReadGuard_ {
+   public:
+    explicit ReadGuard_ (const concurrent_map &home) {
+      size_t shard = shard_();
+      while (true) {
+        size_t epoch = home.epoch_.load();
+        counter_ = &home.counters_[epoch & 1][shard].readers;
+        counter_->fetch_add(1);
+        if (home.epoch_.load() == epoch) return;
+        counter_->fetch_sub(1);
+      }
+    }
+    ReadGuard_ (const ReadGuard_ &other) = delete;
+    auto operator= (const ReadGuard_ &other) -> ReadGuard_ & = delete;
+    ~ReadGuard_ () { counter_->fetch_sub(1); }
+   private:
+    std::atomic<size_t> *counter_;
+  };
+
+  std::atomic<snapshot_type *> current_ { nullptr };
+  mutable std::atomic<size_t> epoch_ { 0 };
+  // readers counted under even and odd epochs.
+  mutable Counter_ counters_[2][kShards_];
+  std::mutex writeLock_;
+  [[no_unique_address]] SnapshotAlloc_ alloc_;
+
+  /// The counter shard of the calling thread, assigned round-robin.
+  static auto shard_ () -> size_t {
+    static std::atomic<size_t> next { 0 };
+    thread_local size_t shard = next.fetch_add(1, std::memory_order_relaxed) % kShards_;
+    return shard;
+  }
+  /// Waits until no reader may see a version replaced before the call.
+  auto synchronize_ () -> void {
+    size_t epoch = epoch_.fetch_add(1);
+    for (auto &counter : counters_[epoch & 1]) {
+      while (counter.readers.load() != 0) std::this_thread::yield();
+    }
+  }
+};
+
+} // namespace sjtu
+
+#endif // SJTU_CONCURRENT_MAP_HPP_
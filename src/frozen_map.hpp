@@ -0,0 +1,432 @@
+#ifndef SJTU_FROZEN_MAP_HPP_
+#define SJTU_FROZEN_MAP_HPP_
+
+#include "utility.hpp"
+#include "exceptions.hpp"
+#include "map.hpp"
+#include "memory.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+
+namespace sjtu {
+
+/**
+ * An immutable ordered map, built once from a map or a
+ * range, for read-mostly serving.
+ *
+ * The keys are laid out in Eytzinger order, i.e. as a
+ * complete binary search tree stored breadth-first: the
+ * children of slot k are slots 2k and 2k + 1. A lookup walks
+ * down from slot 1 without branching on the comparisons,
+ * and the 2^i slots on level i are contiguous, so the top
+ * levels share a few cache lines, and the slots a few
+ * levels below the current one can be prefetched while the
+ * comparisons on the way there are still running.
+ *
+ * The keys are kept apart from the values, so that a
+ * cache line holds as many keys as possible; values are
+ * stored in the same order in a second array. Iterators go
+ * in key order, hopping between the slots.
+ */
+template <
+  typename KeyType,
+  typename ValueType,
+  typename Compare = std::less<KeyType>,
+  typename Allocator = allocator<pair<const KeyType, ValueType>>
+> class frozen_map {
+ public:
+  using value_type = pair<const KeyType, ValueType>;
+  class const_iterator {
+   private:
+    const frozen_map *home_ = nullptr;
+    size_t index_ = 0;
+    friend class frozen_map;
+   public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = const frozen_map::value_type;
+    using pointer = value_type *;
+    using reference = value_type &;
+    using iterator_category = std::bidirectional_iterator_tag;
+
+    const_iterator () = default;
+    const_iterator (const frozen_map *home, size_t index) : home_(home), index_(index) {}
+    auto operator++ (int) -> const_iterator {
+      const_iterator retval = *this;
+      ++*this;
+      return retval;
+    }
+    auto operator++ () -> const_iterator & {
+      if (home_ == nullptr || index_ == 0) throw invalid_iterator();
+      index_ = home_->next_(index_);
+      return *this;
+    }
+    auto operator-- (int) -> const_iterator {
+      const_iterator retval = *this;
+      --*this;
+      return retval;
+    }
+    auto operator-- () -> const_iterator & {
+      if (home_ == nullptr) throw invalid_iterator();
+      size_t prev = index_ == 0 ? home_->last_() : home_->prev_(index_);
+      if (prev == 0) throw invalid_iterator();
+      index_ = prev;
+      return *this;
+    }
+    auto operator* () const -> value_type & {
+      return home_->values_[index_];
+    }
+    auto operator== (const const_iterator &rhs) const -> bool {
+      return home_ == rhs.home_ && index_ == rhs.index_;
+    }
+    auto operator!= (const const_iterator &rhs) const -> bool {
+      return !(*this == rhs);
+    }
+
+    auto operator-> () const noexcept -> value_type * {
+      return &home_->values_[index_];
+    }
+  };
+  /// A frozen map is never modified; its iterators are all const.
+  using iterator = const_iterator;
+
+  frozen_map () = default;
+  explicit frozen_map (const Allocator &alloc) : valueAlloc_(alloc), keyAlloc_(alloc) {}
+  /**
+   * Freezes a copy of the contents of m, in O(n).
+   */
+  template <typename Alloc, typename Engine>
+  explicit frozen_map (const map<KeyType, ValueType, Compare, Alloc, Engine> &m, const Allocator &alloc = Allocator())
+    : valueAlloc_(alloc), keyAlloc_(alloc) {
+    build_(m.cbegin(), m.size());
+  }
+  /**
+   * Constructs the map with the contents of [first, last),
+   *   keeping the first of elements with equivalent keys,
+   *   in O(n log n); they are sorted in a map first.
+   */
+  template <typename InputIt>
+  frozen_map (InputIt first, InputIt last, const Allocator &alloc = Allocator())
+    : valueAlloc_(alloc), keyAlloc_(alloc) {
+    map<KeyType, ValueType, Compare, Allocator> sorted(first, last, alloc);
+    build_(sorted.cbegin(), sorted.size());
+  }
+  frozen_map (const frozen_map &other)
+    : frozen_map(std::allocator_traits<Allocator>::select_on_container_copy_construction(other.valueAlloc_)) {
+    copy_(other);
+  }
+  auto operator= (const frozen_map &other) -> frozen_map & {
+    if (this == &other) return *this;
+    constexpr bool kPropagate =
+      std::allocator_traits<Allocator>::propagate_on_container_copy_assignment::value;
+    frozen_map copy(kPropagate ? other.get_allocator() : get_allocator());
+    copy.copy_(other);
+    destroy_();
+    size_ = copy.size_;
+    keys_ = copy.keys_;
+    values_ = copy.values_;
+    if constexpr (kPropagate) {
+      valueAlloc_ = copy.valueAlloc_;
+      keyAlloc_ = copy.keyAlloc_;
+    }
+    copy.size_ = 0;
+    copy.keys_ = nullptr;
+    copy.values_ = nullptr;
+    return *this;
+  }
+  ~frozen_map () {
+    destroy_();
+  }
+  auto get_allocator () const -> Allocator {
+    return valueAlloc_;
+  }
+
+  /**
+   * access specified element with bounds checking
+   * throw index_out_of_bound if such key does not exist.
+   */
+  auto at (const KeyType &key) const -> const ValueType & {
+    size_t k = find_(key);
+    if (k == 0) throw index_out_of_bound();
+    return values_[k].second;
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto at (const K &key) const -> const ValueType & {
+    size_t k = find_(key);
+    if (k == 0) throw index_out_of_bound();
+    return values_[k].second;
+  }
+  auto operator[] (const KeyType &key) const -> const ValueType & {
+    return at(key);
+  }
+  auto begin () const -> const_iterator {
+    return { this, first_() };
+  }
+  auto cbegin () const -> const_iterator {
+    return begin();
+  }
+  auto end () const -> const_iterator {
+    return { this, 0 };
+  }
+  auto cend () const -> const_iterator {
+    return end();
+  }
+  auto empty () const -> bool {
+    return size_ == 0;
+  }
+  auto size () const -> size_t {
+    return size_;
+  }
+
+  /**
+   * Returns the number of elements with key equivalent to
+   *   key, which is either 1 or 0.
+   * The templated overloads of the lookups take any type
+   *   comparable with KeyType, and exist only if
+   *   Compare::is_transparent.
+   */
+  auto count (const KeyType &key) const -> size_t {
+    return find_(key) == 0 ? 0 : 1;
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto count (const K &key) const -> size_t {
+    return find_(key) == 0 ? 0 : 1;
+  }
+  /**
+   * Finds an element with key equivalent to key, or returns
+   *   end() if there is none.
+   */
+  auto find (const KeyType &key) const -> const_iterator {
+    return { this, find_(key) };
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto find (const K &key) const -> const_iterator {
+    return { this, find_(key) };
+  }
+  /**
+   * Returns an iterator to the first element whose key is
+   *   not less than key, or end() if there is none.
+   */
+  auto lower_bound (const KeyType &key) const -> const_iterator {
+    return { this, bound_<false>(key) };
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto lower_bound (const K &key) const -> const_iterator {
+    return { this, bound_<false>(key) };
+  }
+  /**
+   * Returns an iterator to the first element whose key is
+   *   greater than key, or end() if there is none.
+   */
+  auto upper_bound (const KeyType &key) const -> const_iterator {
+    return { this, bound_<true>(key) };
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto upper_bound (const K &key) const -> const_iterator {
+    return { this, bound_<true>(key) };
+  }
+  auto equal_range (const KeyType &key) const -> pair<const_iterator, const_iterator> {
+    return pair(lower_bound(key), upper_bound(key));
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto equal_range (const K &key) const -> pair<const_iterator, const_iterator> {
+    return pair(lower_bound(key), upper_bound(key));
+  }
+
+ private:
+  using KeyAlloc_ = typename std::allocator_traits<Allocator>::template rebind_alloc<KeyType>;
+  using ValueAlloc_ = typename std::allocator_traits<Allocator>::template rebind_alloc<value_type>;
+  static constexpr size_t kCacheLine_ = 64;
+  // slot k * kPrefetchStride_ is the leftmost descendant of k,
+  // log2(kPrefetchStride_) levels down. The keys start on a
+  // cache line, so if sizeof(KeyType) divides the line, the
+  // line there holds all the descendants on that level.
+  static constexpr size_t kPrefetchStride_ =
+    sizeof(KeyType) >= kCacheLine_ ? 1 : kCacheLine_ / sizeof(KeyType);
+  static constexpr size_t kKeyAlign_ = alignof(KeyType) > kCacheLine_ ? alignof(KeyType) : kCacheLine_;
+  /// The unit the keys are allocated in, for their alignment.
+  class alignas(kKeyAlign_) KeyLine_ {
+    char bytes_[kKeyAlign_];
+  };
+  using LineAlloc_ = typename std::allocator_traits<Allocator>::template rebind_alloc<KeyLine_>;
+
+  // slots 1 to size_ of both arrays hold the elements; slot
+  // 0 is left unconstructed, and stands for end().
+  size_t size_ = 0;
+  KeyType *keys_ = nullptr;
+  value_type *values_ = nullptr;
+  [[no_unique_address]] ValueAlloc_ valueAlloc_;
+  [[no_unique_address]] KeyAlloc_ keyAlloc_;
+  [[no_unique_address]] Compare cmp_;
+
+  auto leftmost_ (size_t k) const -> size_t {
+    while (2 * k <= size_) k = 2 * k;
+    return k;
+  }
+  auto rightmost_ (size_t k) const -> size_t {
+    while (2 * k + 1 <= size_) k = 2 * k + 1;
+    return k;
+  }
+  /// the slot of the smallest key, or 0 if empty.
+  auto first_ () const -> size_t {
+    return size_ == 0 ? 0 : leftmost_(1);
+  }
+  /// the slot of the greatest key, or 0 if empty.
+  auto last_ () const -> size_t {
+    return size_ == 0 ? 0 : rightmost_(1);
+  }
+  /// the in-order successor of slot k, or 0 if k is the last.
+  auto next_ (size_t k) const -> size_t {
+    if (2 * k + 1 <= size_) return leftmost_(2 * k + 1);
+    // climb out of right children, then once more.
+    return k >> (trailingZeros_(~k) + 1);
+  }
+  /// the in-order predecessor of slot k, or 0 if k is the first.
+  auto prev_ (size_t k) const -> size_t {
+    if (2 * k <= size_) return rightmost_(2 * k);
+    // climb out of left children, then once more.
+    return k >> (trailingZeros_(k) + 1);
+  }
+  static auto trailingZeros_ (size_t k) -> unsigned {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(k);
+#else
+    unsigned n = 0;
+    for (; (k & 1) == 0; k >>= 1) ++n;
+    return n;
+#endif
+  }
+  auto prefetch_ (size_t k) const -> void {
+#if defined(__GNUC__) || defined(__clang__)
+    // a hint only: the address may be past the array, so it
+    // is computed as an integer, not as a pointer.
+    auto address = reinterpret_cast<std::uintptr_t>(keys_) + k * kPrefetchStride_ * sizeof(KeyType);
+    __builtin_prefetch(reinterpret_cast<const void *>(address));
+#else
+    (void) k;
+#endif
+  }
+
+  /**
+   * The slot of the first key not less than (if !kUpper),
+   *   or greater than (if kUpper), key; 0 if there is none.
+   * The walk goes right on every key before the bound, and
+   *   left otherwise, down past a leaf; the bound is where
+   *   it last went left, which is found by dropping the
+   *   trailing right turns, and that left turn, from k.
+   */
+  template <bool kUpper, typename K>
+  auto bound_ (const K &key) const -> size_t {
+    size_t k = 1;
+    while (k <= size_) {
+      prefetch_(k);
+      if constexpr (kUpper) {
+        k = 2 * k + !cmp_(key, keys_[k]);
+      } else {
+        k = 2 * k + cmp_(keys_[k], key);
+      }
+    }
+    return k >> (trailingZeros_(~k) + 1);
+  }
+  template <typename K>
+  auto find_ (const K &key) const -> size_t {
+    size_t k = bound_<false>(key);
+    if (k == 0 || cmp_(key, keys_[k])) return 0;
+    return k;
+  }
+
+  /// The number of KeyLine_ taken by slots 0 to n.
+  static auto keyLines_ (size_t n) -> size_t {
+    return ((n + 1) * sizeof(KeyType) + kKeyAlign_ - 1) / kKeyAlign_;
+  }
+  auto allocate_ (size_t n) -> void {
+    LineAlloc_ lineAlloc(keyAlloc_);
+    KeyLine_ *lines = std::allocator_traits<LineAlloc_>::allocate(lineAlloc, keyLines_(n));
+    try {
+      values_ = std::allocator_traits<ValueAlloc_>::allocate(valueAlloc_, n + 1);
+    } catch (...) {
+      std::allocator_traits<LineAlloc_>::deallocate(lineAlloc, lines, keyLines_(n));
+      throw;
+    }
+    keys_ = reinterpret_cast<KeyType *>(lines);
+  }
+  /**
+   * Fills the slots in order with the n elements from it,
+   *   which come in ascending order of key.
+   */
+  template <typename It>
+  auto build_ (It it, size_t n) -> void {
+    if (n == 0) return;
+    allocate_(n);
+    size_ = n;
+    size_t k = first_();
+    size_t built = 0;
+    try {
+      for (; built < n; ++built, ++it, k = next_(k)) {
+        std::allocator_traits<KeyAlloc_>::construct(keyAlloc_, keys_ + k, it->first);
+        try {
+          std::allocator_traits<ValueAlloc_>::construct(valueAlloc_, values_ + k, *it);
+        } catch (...) {
+          std::allocator_traits<KeyAlloc_>::destroy(keyAlloc_, keys_ + k);
+          throw;
+        }
+      }
+    } catch (...) {
+      destroyFirst_(built);
+      throw;
+    }
+  }
+  /// Copies the slots of other one by one, as they are.
+  auto copy_ (const frozen_map &other) -> void {
+    if (other.size_ == 0) return;
+    allocate_(other.size_);
+    size_ = other.size_;
+    size_t k = 1;
+    try {
+      for (; k <= size_; ++k) {
+        std::allocator_traits<KeyAlloc_>::construct(keyAlloc_, keys_ + k, other.keys_[k]);
+        try {
+          std::allocator_traits<ValueAlloc_>::construct(valueAlloc_, values_ + k, other.values_[k]);
+        } catch (...) {
+          std::allocator_traits<KeyAlloc_>::destroy(keyAlloc_, keys_ + k);
+          throw;
+        }
+      }
+    } catch (...) {
+      for (size_t i = 1; i < k; ++i) destroySlot_(i);
+      deallocate_();
+      throw;
+    }
+  }
+  /// Undoes build_ after the first n slots in order were built.
+  auto destroyFirst_ (size_t n) -> void {
+    size_t k = first_();
+    for (size_t i = 0; i < n; ++i, k = next_(k)) destroySlot_(k);
+    deallocate_();
+  }
+  auto destroySlot_ (size_t k) -> void {
+    std::allocator_traits<ValueAlloc_>::destroy(valueAlloc_, values_ + k);
+    std::allocator_traits<KeyAlloc_>::destroy(keyAlloc_, keys_ + k);
+  }
+  auto deallocate_ () -> void {
+    std::allocator_traits<ValueAlloc_>::deallocate(valueAlloc_, values_, size_ + 1);
+    LineAlloc_ lineAlloc(keyAlloc_);
+    std::allocator_traits<LineAlloc_>::deallocate(lineAlloc, reinterpret_cast<KeyLine_ *>(keys_), keyLines_(size_));
+    size_ = 0;
+    keys_ = nullptr;
+    values_ = nullptr;
+  }
+  auto destroy_ () -> void {
+    if (keys_ == nullptr) return;
+    for (size_t k = 1; k <= size_; ++k) destroySlot_(k);
+    deallocate_();
+  }
+};
+
+} // namespace sjtu
+
+#endif // SJTU_FROZEN_MAP_HPP_
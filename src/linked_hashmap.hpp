@@ -4,8 +4,10 @@
 // only for std::equal_to<T> and std::hash<T>
 #include <functional>
 #include <cstddef>
+#include <memory>
 #include "utility.hpp"
 #include "exceptions.hpp"
+#include "memory.hpp"
 
 #ifdef DEBUG
 #include <iostream>
@@ -31,12 +33,15 @@ auto rehash (T value) -> unsigned {
  *
  * Note that insertion order is not affected if a key is re-inserted
  * into the map.
+ *
+ * Entries and bucket arrays are allocated from Allocator.
  */
 template <
   typename Key,
   typename Value,
   typename Hash = std::hash<Key>,
-  typename Equal = std::equal_to<Key>
+  typename Equal = std::equal_to<Key>,
+  typename Allocator = allocator<pair<const Key, Value>>
 > class linked_hashmap {
  private:
   struct ListNode;
@@ -168,17 +173,21 @@ template <
   };
 
   linked_hashmap () = default;
-  linked_hashmap (const linked_hashmap &other) { *this = other; }
+  explicit linked_hashmap (const Allocator &alloc) : alloc_(alloc) {}
+  linked_hashmap (const linked_hashmap &other)
+    : alloc_(std::allocator_traits<NodeAlloc_>::select_on_container_copy_construction(other.alloc_)) {
+    *this = other;
+  }
   auto operator= (const linked_hashmap &other) -> linked_hashmap & {
     if (this == &other) return *this;
     clear();
     capacity_ = other.capacity_;
     size_ = other.size_;
-    store_ = new ListNode[pow2[capacity_]];
+    store_ = newBuckets_(capacity_);
     const ListNode *node = &other.pivot_;
     for (int i = 0; i < size_; ++i) {
       node = node->next_;
-      Node *newNode = new Node(*(node->self));
+      Node *newNode = internal::newObject<Node>(alloc_, *(node->self));
       int ix = newNode->hash & mask[capacity_];
       newNode->hashList.insertBefore(&store_[ix]);
       newNode->iteratorList.insertBefore(&pivot_);
@@ -188,6 +197,9 @@ template <
   ~linked_hashmap () {
     destroy_();
   }
+  auto get_allocator () const -> Allocator {
+    return Allocator(alloc_);
+  }
 
   /**
    * access specified element with bounds checking
@@ -202,6 +214,18 @@ template <
   auto at (const Key &key) const -> const Value & {
     return const_cast<linked_hashmap *>(this)->at(key);
   }
+  template <typename K, typename H = Hash, typename E = Equal,
+            typename = typename H::is_transparent, typename = typename E::is_transparent>
+  auto at (const K &key) -> Value & {
+    auto it = find(key);
+    if (it == end()) throw index_out_of_bound();
+    return it->second;
+  }
+  template <typename K, typename H = Hash, typename E = Equal,
+            typename = typename H::is_transparent, typename = typename E::is_transparent>
+  auto at (const K &key) const -> const Value & {
+    return const_cast<linked_hashmap *>(this)->at(key);
+  }
 
   /**
    * access specified element
@@ -255,7 +279,7 @@ template <
     }
     growIfNeeded_();
     int ix = hash & mask[capacity_];
-    Node *node = new Node(value, hash);
+    Node *node = internal::newObject<Node>(alloc_, value, hash);
     node->hashList.insertBefore(&store_[ix]);
     node->iteratorList.insertBefore(&pivot_);
     ++size_;
@@ -270,7 +294,7 @@ template <
     if (pos == end() || pos.home_ != this) throw 1;
     pos.node_->self->hashList.remove();
     pos.node_->self->iteratorList.remove();
-    delete pos.node_->self;
+    internal::deleteObject(alloc_, pos.node_->self);
     pos.node_ = &pivot_;
     --size_;
   }
@@ -282,7 +306,12 @@ template <
    *     since this container does not allow duplicates.
    */
   auto count (const Key &key) const -> size_t {
-    return find(key) == cend() ? 0 : 1;
+    return findNode_(key) == nullptr ? 0 : 1;
+  }
+  template <typename K, typename H = Hash, typename E = Equal,
+            typename = typename H::is_transparent, typename = typename E::is_transparent>
+  auto count (const K &key) const -> size_t {
+    return findNode_(key) == nullptr ? 0 : 1;
   }
 
   /**
@@ -290,18 +319,32 @@ template <
    * key value of the element to search for.
    * Iterator to an element with key equivalent to key.
    *   If no such element is found, past-the-end (see end()) iterator is returned.
+   * The templated overloads of find, at and count take any
+   *   type that Hash and Equal accept along with Key, e.g.
+   *   a string view for string keys, without converting it
+   *   to Key; they exist only if both Hash::is_transparent
+   *   and Equal::is_transparent.
    */
   auto find (const Key &key) -> iterator {
-    if (empty()) return end();
-    auto ix = hash_(key) & mask[capacity_];
-    if (store_[ix].next() == nullptr) return end();
-    Node *node = store_[ix].next()->find(key);
+    Node *node = findNode_(key);
     if (node == nullptr) return end();
     return { &node->iteratorList, this };
   }
   auto find (const Key &key) const -> const_iterator {
     return const_cast<linked_hashmap *>(this)->find(key);
   }
+  template <typename K, typename H = Hash, typename E = Equal,
+            typename = typename H::is_transparent, typename = typename E::is_transparent>
+  auto find (const K &key) -> iterator {
+    Node *node = findNode_(key);
+    if (node == nullptr) return end();
+    return { &node->iteratorList, this };
+  }
+  template <typename K, typename H = Hash, typename E = Equal,
+            typename = typename H::is_transparent, typename = typename E::is_transparent>
+  auto find (const K &key) const -> const_iterator {
+    return const_cast<linked_hashmap *>(this)->find(key);
+  }
 
  private:
   struct Node;
@@ -335,40 +378,65 @@ template <
     Node () = default;
     Node (const Node &node) : value(node.value), hash(node.hash) {}
     Node (const value_type &value, unsigned hash) : value(value), hash(hash) {}
-    auto find (const Key &key) -> Node * {
+    template <typename K>
+    auto find (const K &key) -> Node * {
       if (Equal()(key, value.first)) return this;
       if (hashList.next() == nullptr) return nullptr;
       return hashList.next()->find(key);
     }
   };
+  using NodeAlloc_ = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+  using BucketAlloc_ = typename std::allocator_traits<Allocator>::template rebind_alloc<ListNode>;
   ListNode pivot_;
   ListNode *store_ = nullptr;
   int size_ = 0;
   int capacity_ = 0;
+  [[no_unique_address]] NodeAlloc_ alloc_;
   constexpr static int kThreshold_ = 2;
   Hash hash0_;
-  auto hash_ (const Key &key) const -> unsigned {
+  template <typename K>
+  auto hash_ (const K &key) const -> unsigned {
     return rehash(hash0_(key));
   }
+  /// The node with key equivalent to key, or nullptr.
+  template <typename K>
+  auto findNode_ (const K &key) const -> Node * {
+    if (empty()) return nullptr;
+    auto ix = hash_(key) & mask[capacity_];
+    if (store_[ix].next() == nullptr) return nullptr;
+    return store_[ix].next()->find(key);
+  }
   auto growIfNeeded_ () -> void {
-    if ((size_ + 1) * kThreshold_ > pow2[capacity_]) grow_();
+    if (static_cast<unsigned long long>(size_ + 1) * kThreshold_ > pow2[capacity_]) grow_();
+  }
+  /// Allocates 2^capacity empty buckets.
+  auto newBuckets_ (int capacity) -> ListNode * {
+    BucketAlloc_ alloc(alloc_);
+    ListNode *buckets = std::allocator_traits<BucketAlloc_>::allocate(alloc, pow2[capacity]);
+    for (unsigned long long i = 0; i < pow2[capacity]; ++i) new(buckets + i) ListNode();
+    return buckets;
+  }
+  /// Frees 2^capacity buckets. ListNode is trivially destructible.
+  auto deleteBuckets_ (ListNode *buckets, int capacity) -> void {
+    BucketAlloc_ alloc(alloc_);
+    std::allocator_traits<BucketAlloc_>::deallocate(alloc, buckets, pow2[capacity]);
   }
   auto grow_ () -> void {
     if (capacity_ == 0) {
       capacity_ = 2;
-      store_ = new ListNode[4];
+      store_ = newBuckets_(capacity_);
       return;
     }
     int newCapacity = capacity_ + 1;
-    ListNode *prospective = new ListNode[pow2[newCapacity]];
+    ListNode *prospective = newBuckets_(newCapacity);
     ListNode *node = &pivot_;
     for (int i = 0; i < size_; ++i) {
       node = node->next_;
       int ix = node->self->hash & mask[newCapacity];
       node->self->hashList.insertBefore(&prospective[ix]);
     }
+    deleteBuckets_(store_, capacity_);
     capacity_ = newCapacity;
-    delete[] store_;
     store_ = prospective;
   }
 
@@ -376,12 +444,12 @@ template <
     ListNode *node = pivot_.next_;
     for (int i = 0; i < size_; ++i) {
       ListNode *next = node->next_;
-      delete node->self;
+      internal::deleteObject(alloc_, node->self);
       node = next;
     }
+    if (store_ != nullptr) deleteBuckets_(store_, capacity_);
     capacity_ = 0;
     size_ = 0;
-    delete[] store_;
     store_ = nullptr;
     pivot_.init();
   }
@@ -7,6 +7,8 @@
 // only for std::less<T>
 #include <functional>
 #include <cstddef>
+#include <tuple>
+#include <utility>
 #include "utility.hpp"
 #include "exceptions.hpp"
 
@@ -14,6 +16,8 @@
 #include <iostream>
 #endif
 
+#include "btree.hpp"
+#include "memory.hpp"
 #include "tree.hpp"
 #include "type_traits.hpp"
 
@@ -40,16 +44,49 @@ class MapValueCompare {
   auto operator() (const Pair &lhs, const Pair &rhs) const -> bool {
     return cmp_(lhs.first, rhs.first);
   }
+  // heterogeneous lookup, for transparent comparators only.
+  template <typename K>
+  auto operator() (const K &lhs, const Pair &rhs) const -> bool {
+    return cmp_(lhs, rhs.first);
+  }
+  template <typename K>
+  auto operator() (const Pair &lhs, const K &rhs) const -> bool {
+    return cmp_(lhs.first, rhs);
+  }
+  // against bare keys, e.g. the separators in a B+-tree.
+  template <typename K>
+  auto operator() (const K &lhs, const Key &rhs) const -> bool {
+    return cmp_(lhs, rhs);
+  }
+  template <typename K>
+  auto operator() (const Key &lhs, const K &rhs) const -> bool {
+    return cmp_(lhs, rhs);
+  }
 };
 
 } // namespace internal
 
-template <typename KeyType, typename ValueType, typename Compare = std::less<KeyType>>
-class map {
+/**
+ * An ordered map. Engine selects the balanced tree behind
+ * it: Engine::type<value_type, Cmp, Allocator> must be a tree
+ * with the interface of panic::RbTree. See panic::RbTreeEngine
+ * and panic::BTreeEngine.
+ */
+template <
+  typename KeyType,
+  typename ValueType,
+  typename Compare = std::less<KeyType>,
+  typename Allocator = allocator<pair<const KeyType, ValueType>>,
+  typename Engine = panic::RbTreeEngine<>
+> class map {
  public:
   using value_type = pair<const KeyType, ValueType>;
  private:
-  using TreeType = typename panic::RbTree<value_type, internal::MapValueCompare<KeyType, ValueType, Compare>>;
+  using TreeType = typename Engine::template type<
+    value_type,
+    internal::MapValueCompare<KeyType, ValueType, Compare>,
+    Allocator
+  >;
  public:
   /**
    * the internal type of data.
@@ -60,6 +97,29 @@ class map {
   using const_iterator = typename TreeType::const_iterator;
 
   map () = default;
+  explicit map (const Allocator &alloc) : tree_(alloc) {}
+  /**
+   * Constructs the map with the contents of [first, last),
+   *   keeping the first of elements with equivalent keys.
+   * The tree is built balanced in one go, on nodes allocated
+   *   contiguously: O(n) if the range is sorted by key
+   *   without duplicates, e.g. a snapshot of another map,
+   *   and O(n log n) otherwise.
+   */
+  template <typename InputIt>
+  map (InputIt first, InputIt last, const Allocator &alloc = Allocator())
+    : tree_(first, last, alloc) {}
+  /**
+   * Replaces the contents with copies of those of other,
+   *   like the copy assignment, but with up to threads
+   *   threads copying the halves of large subtrees at once.
+   */
+  auto assign (const map &other, size_t threads = 1) -> void {
+    tree_.assign(other.tree_, threads);
+  }
+  auto get_allocator () const -> Allocator {
+    return tree_.get_allocator();
+  }
   /**
    * access specified element with bounds checking
    * Returns a reference to the mapped value of the element with key equivalent to key.
@@ -75,15 +135,25 @@ class map {
     if (it == tree_.cend()) throw index_out_of_bound();
     return it->second;
   }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto at (const K &key) -> ValueType & {
+    auto it = tree_.find(key);
+    if (it == tree_.end()) throw index_out_of_bound();
+    return it->second;
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto at (const K &key) const -> const ValueType & {
+    auto it = tree_.find(key);
+    if (it == tree_.cend()) throw index_out_of_bound();
+    return it->second;
+  }
   /**
    * access specified element
    * Returns a reference to the value that is mapped to a key equivalent to key,
    *   performing an insertion if such key does not already exist.
    */
   auto operator[] (const KeyType &key) -> ValueType & {
-    // we need to use the default constructor here. Too bad we have no choice.
-    auto p = tree_.insert(pair(key, ValueType()));
-    return p.first->second;
+    return try_emplace(key).first->second;
   }
   /**
    * behave like at() throw index_out_of_bound if such key does not exist.
@@ -138,6 +208,81 @@ class map {
   auto insert (const value_type &value) -> pair<iterator, bool> {
     return tree_.insert(value);
   }
+  /**
+   * Inserts value, using hint as a suggestion of where it goes.
+   * Amortized O(1) if value belongs right before or right
+   *   after hint, e.g. end() when keys come in ascending order.
+   * return the iterator to the new element,
+   *   or to the element that prevented the insertion.
+   */
+  auto insert (const_iterator hint, const value_type &value) -> iterator {
+    return tree_.insert(hint, value);
+  }
+  /**
+   * Inserts an element with key, and a value constructed in
+   *   place from args, if there is no element with key yet.
+   *   Otherwise nothing is constructed, and args are left
+   *   as they are.
+   * return a pair, the first of the pair is
+   *   the iterator to the new element (or the element that prevented the insertion),
+   *   the second one is true if insert successfully, or false.
+   */
+  template <typename ...Args>
+  auto try_emplace (const KeyType &key, Args &&...args) -> pair<iterator, bool> {
+    return tree_.try_emplace(
+      key,
+      std::piecewise_construct,
+      std::forward_as_tuple(key),
+      std::forward_as_tuple(std::forward<Args>(args)...)
+    );
+  }
+  /**
+   * Like try_emplace(const KeyType &, args), but moves key
+   *   into the new element; key is left as it is if nothing
+   *   is inserted.
+   */
+  template <typename ...Args>
+  auto try_emplace (KeyType &&key, Args &&...args) -> pair<iterator, bool> {
+    // the tree only reads key before the element is built from it.
+    return tree_.try_emplace(
+      key,
+      std::piecewise_construct,
+      std::forward_as_tuple(std::move(key)),
+      std::forward_as_tuple(std::forward<Args>(args)...)
+    );
+  }
+  /**
+   * Assigns obj to the value mapped to key if there is one,
+   *   and inserts an element with key and obj otherwise.
+   * return a pair, the first of the pair is
+   *   the iterator to the element,
+   *   the second one is true if it is inserted, or false if assigned.
+   */
+  template <typename M>
+  auto insert_or_assign (const KeyType &key, M &&obj) -> pair<iterator, bool> {
+    auto res = try_emplace(key, std::forward<M>(obj));
+    // obj is left as it is if nothing was inserted.
+    if (!res.second) res.first->second = std::forward<M>(obj);
+    return res;
+  }
+  /// Like insert_or_assign(const KeyType &, obj), but moves key into a new element.
+  template <typename M>
+  auto insert_or_assign (KeyType &&key, M &&obj) -> pair<iterator, bool> {
+    auto res = try_emplace(std::move(key), std::forward<M>(obj));
+    if (!res.second) res.first->second = std::forward<M>(obj);
+    return res;
+  }
+  /**
+   * Constructs value_type from args in a new node, and
+   *   inserts it as insert(hint, value) does; the node is
+   *   destroyed if the key is already there.
+   * btree_map constructs the value aside and moves it into a
+   *   leaf.
+   */
+  template <typename ...Args>
+  auto emplace_hint (const_iterator hint, Args &&...args) -> iterator {
+    return tree_.emplace_hint(hint, std::forward<Args>(args)...);
+  }
   /**
    * erase the element at pos.
    * throw if pos pointed to a bad element (pos == this->end() || pos points an element out of this)
@@ -145,6 +290,41 @@ class map {
   auto erase (iterator pos) -> void {
     return tree_.erase(pos);
   }
+  /**
+   * Erases the element with key equivalent to key, if any.
+   * return the number of elements erased, 1 or 0.
+   */
+  auto erase (const KeyType &key) -> size_t {
+    auto it = tree_.find(key);
+    if (it == tree_.end()) return 0;
+    tree_.erase(it);
+    return 1;
+  }
+  /**
+   * Erases the elements in [first, last), and returns an
+   *   iterator to the element after them.
+   * O(log n + k) for k elements, as a long range is cut out
+   *   of the tree at once.
+   * btree_map erases the elements one by one instead, each
+   *   with a lookup by key and a rebalance, in O(k log n):
+   *   erasing half of a large btree_map costs about as much
+   *   as erasing those keys one at a time.
+   * throw invalid_iterator if the range is not one of this map.
+   */
+  auto erase (const_iterator first, const_iterator last) -> iterator {
+    return tree_.erase(first, last);
+  }
+  /**
+   * Erases the elements for which pred returns true, and
+   *   returns how many. O(n) if many are erased, as the
+   *   rest is rebuilt at once.
+   * btree_map erases the k elements one by one instead, in
+   *   O(n + k log n).
+   */
+  template <typename Pred>
+  auto erase_if (Pred pred) -> size_t {
+    return tree_.erase_if(pred);
+  }
   /**
    * Returns the number of elements with key
    *   that compares equivalent to the specified argument,
@@ -156,11 +336,20 @@ class map {
     auto it = tree_.find(key);
     return it == tree_.cend() ? 0 : 1;
   }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto count (const K &key) const -> size_t {
+    auto it = tree_.find(key);
+    return it == tree_.cend() ? 0 : 1;
+  }
   /**
    * Finds an element with key equivalent to key.
    * key value of the element to search for.
    * Iterator to an element with key equivalent to key.
    *   If no such element is found, past-the-end (see end()) iterator is returned.
+   * The templated overloads of find, at and count take any
+   *   type comparable with KeyType, e.g. a string view for
+   *   string keys, without converting it to KeyType; they
+   *   exist only if Compare::is_transparent.
    */
   auto find (const KeyType &key) -> iterator {
     return tree_.find(key);
@@ -168,6 +357,137 @@ class map {
   auto find (const KeyType &key) const -> const_iterator {
     return tree_.find(key);
   }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto find (const K &key) -> iterator {
+    return tree_.find(key);
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto find (const K &key) const -> const_iterator {
+    return tree_.find(key);
+  }
+  /**
+   * Returns an iterator to the first element whose key is
+   *   not less than key, or end() if there is none.
+   * The templated overloads take any type comparable with
+   *   KeyType, and exist only if Compare::is_transparent.
+   */
+  auto lower_bound (const KeyType &key) -> iterator {
+    return tree_.lower_bound(key);
+  }
+  auto lower_bound (const KeyType &key) const -> const_iterator {
+    return tree_.lower_bound(key);
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto lower_bound (const K &key) -> iterator {
+    return tree_.lower_bound(key);
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto lower_bound (const K &key) const -> const_iterator {
+    return tree_.lower_bound(key);
+  }
+  /**
+   * Returns an iterator to the first element whose key is
+   *   greater than key, or end() if there is none.
+   */
+  auto upper_bound (const KeyType &key) -> iterator {
+    return tree_.upper_bound(key);
+  }
+  auto upper_bound (const KeyType &key) const -> const_iterator {
+    return tree_.upper_bound(key);
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto upper_bound (const K &key) -> iterator {
+    return tree_.upper_bound(key);
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto upper_bound (const K &key) const -> const_iterator {
+    return tree_.upper_bound(key);
+  }
+  /**
+   * Returns the range of elements with keys equivalent to
+   *   key, i.e. pair(lower_bound(key), upper_bound(key)).
+   */
+  auto equal_range (const KeyType &key) -> pair<iterator, iterator> {
+    return tree_.equal_range(key);
+  }
+  auto equal_range (const KeyType &key) const -> pair<const_iterator, const_iterator> {
+    return tree_.equal_range(key);
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto equal_range (const K &key) -> pair<iterator, iterator> {
+    return tree_.equal_range(key);
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  auto equal_range (const K &key) const -> pair<const_iterator, const_iterator> {
+    return tree_.equal_range(key);
+  }
+  /**
+   * Moves the elements with keys not less than key into a
+   *   new map, and returns it: the nodes are moved, not
+   *   copied, in O(log n); then the smaller part is counted,
+   *   in O(k) for k elements, unless it is a ranked_map.
+   * Iterators to the moved elements are invalidated.
+   */
+  auto split_at (const KeyType &key) -> map {
+    map rest(get_allocator());
+    tree_.split(key, rest.tree_);
+    return rest;
+  }
+  /**
+   * Moves all the elements of other into this map, in
+   *   O(log n) if the allocators compare equal.
+   * The keys of other must all be less than, or all greater
+   *   than, the keys in this map;
+   *   throw runtime_error otherwise, and nothing is moved.
+   * Iterators to the elements of other are invalidated.
+   */
+  auto splice (map &other) -> void {
+    tree_.join(other.tree_);
+  }
+  /**
+   * Moves the elements of other whose keys are not in this
+   *   map into it; the others stay in other.
+   * O(m log(n / m + 1)) for maps of sizes m <= n, if the
+   *   allocators compare equal, as the nodes are moved, not
+   *   copied; O(m log(n + m)) otherwise.
+   * Up to threads threads split the work on large maps.
+   */
+  auto merge_from (map &other, size_t threads = 1) -> void {
+    tree_.merge(other.tree_, threads);
+  }
+  /**
+   * Erases the elements whose keys are not in other.
+   * O(m log(n / m + 1)) for maps of sizes m <= n, plus O(1)
+   *   per element erased; up to threads threads are used.
+   */
+  auto intersect_with (const map &other, size_t threads = 1) -> void {
+    tree_.intersect(other.tree_, threads);
+  }
+  /**
+   * Erases the elements whose keys are in other, in the
+   *   same time as intersect_with.
+   */
+  auto subtract (const map &other, size_t threads = 1) -> void {
+    tree_.subtract(other.tree_, threads);
+  }
+  /**
+   * Returns an iterator to the k-th smallest element,
+   *   counting from 0, or end() if size() <= k.
+   * Only available for ranked_map; O(log n).
+   */
+  auto nth (size_t k) -> iterator {
+    return tree_.nth(k);
+  }
+  auto nth (size_t k) const -> const_iterator {
+    return tree_.nth(k);
+  }
+  /**
+   * Returns the number of elements with keys less than key.
+   * Only available for ranked_map; O(log n).
+   */
+  auto rank (const KeyType &key) const -> size_t {
+    return tree_.rank(key);
+  }
 
 #ifdef DEBUG
   auto print () -> void {
@@ -177,12 +497,45 @@ class map {
     }
     std::cout << std::endl;
   }
+  /// Checks the invariants of the engine in O(n).
+  auto valid () const -> bool {
+    return tree_.valid();
+  }
 #endif
 
  private:
   TreeType tree_;
 };
 
+/**
+ * A map that also answers order-statistics queries, nth()
+ * and rank(), in O(log n), at the cost of a subtree size in
+ * every node.
+ */
+template <
+  typename KeyType,
+  typename ValueType,
+  typename Compare = std::less<KeyType>,
+  typename Allocator = allocator<pair<const KeyType, ValueType>>
+>
+using ranked_map = map<KeyType, ValueType, Compare, Allocator, panic::RbTreeEngine<true>>;
+
+/**
+ * A map on a B+-tree with nodes of a few cache lines, for
+ * faster lookups and scans in large maps. Insertions and
+ * erasures invalidate its iterators, and assign, split_at,
+ * splice, merge_from, intersect_with, subtract, nth and
+ * rank are not available. Range erase and erase_if take O(log n)
+ * per element erased, rather than O(1) as in map.
+ */
+template <
+  typename KeyType,
+  typename ValueType,
+  typename Compare = std::less<KeyType>,
+  typename Allocator = allocator<pair<const KeyType, ValueType>>
+>
+using btree_map = map<KeyType, ValueType, Compare, Allocator, panic::BTreeEngine<>>;
+
 } // namespace sjtu
 
 #endif // SJTU_MAP_HPP_
@@ -0,0 +1,109 @@
+#ifndef SJTU_MEMORY_HPP_
+#define SJTU_MEMORY_HPP_
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace sjtu {
+
+/**
+ * The default allocator of all the containers. It hands out
+ * malloc'ed memory, and besides the standard allocate and
+ * deallocate, offers
+ *   reallocate(p, nOld, nNew),
+ * which moves a block of trivially relocatable objects with
+ * realloc, growing it in place when possible.
+ *
+ * Any other standard allocator, e.g. an arena allocator or
+ * std::pmr::polymorphic_allocator, could be used in place
+ * of it; containers only go through std::allocator_traits,
+ * and use reallocate only if it exists.
+ */
+template <typename T>
+class allocator {
+ public:
+  using value_type = T;
+
+  allocator () = default;
+  template <typename U>
+  allocator (const allocator<U> &/* unused */) noexcept {}
+
+  auto allocate (size_t n) -> T * {
+    if constexpr (kOverAligned_) {
+      return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+    } else {
+      auto *p = static_cast<T *>(std::malloc(n * sizeof(T)));
+      if (p == nullptr && n != 0) throw std::bad_alloc();
+      return p;
+    }
+  }
+  auto deallocate (T *p, size_t /* n */) noexcept -> void {
+    if constexpr (kOverAligned_) {
+      ::operator delete(p, std::align_val_t(alignof(T)));
+    } else {
+      std::free(p);
+    }
+  }
+  /// Only for trivially relocatable T, and p from allocate.
+  template <typename U = T, typename = std::enable_if_t<!allocator<U>::kOverAligned_>>
+  auto reallocate (T *p, size_t /* nOld */, size_t nNew) -> T * {
+    auto *q = static_cast<T *>(std::realloc(static_cast<void *>(p), nNew * sizeof(T)));
+    if (q == nullptr && nNew != 0) throw std::bad_alloc();
+    return q;
+  }
+
+  template <typename U>
+  auto operator== (const allocator<U> &/* unused */) const noexcept -> bool { return true; }
+  template <typename U>
+  auto operator!= (const allocator<U> &/* unused */) const noexcept -> bool { return false; }
+
+ private:
+  template <typename U>
+  friend class allocator;
+  static constexpr bool kOverAligned_ = alignof(T) > alignof(std::max_align_t);
+};
+
+namespace internal {
+
+template <typename Alloc, typename = void>
+class can_reallocate : public std::false_type {};
+template <typename Alloc>
+class can_reallocate<Alloc, std::void_t<decltype(std::declval<Alloc &>().reallocate(
+  std::declval<typename Alloc::value_type *>(), size_t(), size_t()
+))>> : public std::true_type {};
+/// Whether Alloc offers reallocate, like sjtu::allocator.
+template <typename Alloc>
+constexpr bool can_reallocate_v = can_reallocate<Alloc>::value;
+
+/**
+ * Allocates one T from alloc and constructs it from args,
+ * giving the memory back if the constructor throws.
+ */
+template <typename T, typename Alloc, typename ...Args>
+auto newObject (Alloc &alloc, Args &&...args) -> T * {
+  using Traits = std::allocator_traits<Alloc>;
+  T *p = Traits::allocate(alloc, 1);
+  try {
+    new(p) T(std::forward<Args>(args)...);
+  } catch (...) {
+    Traits::deallocate(alloc, p, 1);
+    throw;
+  }
+  return p;
+}
+/// Destructs p and gives its memory back to alloc.
+template <typename T, typename Alloc>
+auto deleteObject (Alloc &alloc, T *p) noexcept -> void {
+  p->~T();
+  std::allocator_traits<Alloc>::deallocate(alloc, p, 1);
+}
+
+} // namespace internal
+
+} // namespace sjtu
+
+#endif // SJTU_MEMORY_HPP_
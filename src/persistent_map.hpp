@@ -0,0 +1,168 @@
+#ifndef SJTU_PERSISTENT_MAP_HPP_
+#define SJTU_PERSISTENT_MAP_HPP_
+
+#include "utility.hpp"
+#include "exceptions.hpp"
+#include "map.hpp"
+#include "memory.hpp"
+#include "persistent_tree.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <tuple>
+#include <utility>
+
+namespace sjtu {
+
+/**
+ * An ordered map whose copies are snapshots, taken in O(1):
+ * a copy shares all the nodes of the original, and either
+ * of them copies only the O(log n) nodes a write changes,
+ * so the other never sees the write. See
+ * panic::PersistentRbTree.
+ *
+ * Elements are not modified through iterators, which are
+ * all const; at() and operator[] give access to a mapped
+ * value after making it belong to this map alone.
+ *
+ * Iterators hold no parent links, as nodes are shared, so
+ * ++ and -- search from the root, in O(log n) rather than
+ * the amortized O(1) of map, and a full scan takes
+ * O(n log n).
+ */
+template <
+  typename KeyType,
+  typename ValueType,
+  typename Compare = std::less<KeyType>,
+  typename Allocator = allocator<pair<const KeyType, ValueType>>
+> class persistent_map {
+ public:
+  using value_type = pair<const KeyType, ValueType>;
+ private:
+  using TreeType = panic::PersistentRbTree<
+    value_type,
+    internal::MapValueCompare<KeyType, ValueType, Compare>,
+    Allocator
+  >;
+ public:
+  using const_iterator = typename TreeType::const_iterator;
+  using iterator = const_iterator;
+
+  persistent_map () = default;
+  explicit persistent_map (const Allocator &alloc) : tree_(alloc) {}
+  template <typename InputIt>
+  persistent_map (InputIt first, InputIt last, const Allocator &alloc = Allocator())
+    : tree_(alloc) {
+    for (; first != last; ++first) tree_.insert(*first);
+  }
+  auto get_allocator () const -> Allocator {
+    return tree_.get_allocator();
+  }
+  /**
+   * access specified element with bounds checking
+   * Returns a reference to the mapped value of the element with key equivalent to key,
+   *   copying the nodes on the way to it that are shared with other snapshots.
+   * If no such element exists, an exception of type `index_out_of_bound'
+   */
+  auto at (const KeyType &key) -> ValueType & {
+    value_type *value = tree_.edit(key);
+    if (value == nullptr) throw index_out_of_bound();
+    return value->second;
+  }
+  auto at (const KeyType &key) const -> const ValueType & {
+    auto it = tree_.find(key);
+    if (it == tree_.cend()) throw index_out_of_bound();
+    return it->second;
+  }
+  /**
+   * access specified element
+   * Returns a reference to the value that is mapped to a key equivalent to key,
+   *   performing an insertion if such key does not already exist,
+   *   in a single descent that also copies the shared nodes on the way.
+   */
+  auto operator[] (const KeyType &key) -> ValueType & {
+    return tree_.try_emplace(
+      key,
+      std::piecewise_construct,
+      std::forward_as_tuple(key),
+      std::forward_as_tuple()
+    ).first->second;
+  }
+  auto operator[] (const KeyType &key) const -> const ValueType & {
+    return at(key);
+  }
+  auto begin () const -> const_iterator {
+    return tree_.cbegin();
+  }
+  auto cbegin () const -> const_iterator {
+    return tree_.cbegin();
+  }
+  auto end () const -> const_iterator {
+    return tree_.cend();
+  }
+  auto cend () const -> const_iterator {
+    return tree_.cend();
+  }
+  auto empty () const -> bool {
+    return tree_.empty();
+  }
+  auto size () const -> size_t {
+    return tree_.size();
+  }
+  auto clear () -> void {
+    tree_.clear();
+  }
+  /**
+   * insert an element.
+   * return a pair, the first of the pair is
+   *   the iterator to the new element (or the element that prevented the insertion),
+   *   the second one is true if insert successfully, or false.
+   */
+  auto insert (const value_type &value) -> pair<const_iterator, bool> {
+    return tree_.insert(value);
+  }
+  /**
+   * erase the element at pos.
+   * throw if pos pointed to a bad element (pos == this->end() || pos points an element out of this)
+   */
+  auto erase (const_iterator pos) -> void {
+    if (pos == end() || tree_.find(pos->first) != pos) throw invalid_iterator();
+    tree_.erase(pos->first);
+  }
+  /**
+   * Erases the element with key equivalent to key, if any.
+   * return the number of elements erased, 1 or 0.
+   */
+  auto erase (const KeyType &key) -> size_t {
+    return tree_.erase(key);
+  }
+  auto count (const KeyType &key) const -> size_t {
+    return tree_.find(key) == tree_.cend() ? 0 : 1;
+  }
+  auto find (const KeyType &key) const -> const_iterator {
+    return tree_.find(key);
+  }
+  auto lower_bound (const KeyType &key) const -> const_iterator {
+    return tree_.lower_bound(key);
+  }
+  auto upper_bound (const KeyType &key) const -> const_iterator {
+    return tree_.upper_bound(key);
+  }
+  auto equal_range (const KeyType &key) const -> pair<const_iterator, const_iterator> {
+    return tree_.equal_range(key);
+  }
+
+#ifdef DEBUG
+  /// Checks the invariants of the tree in O(n).
+  auto valid () const -> bool {
+    return tree_.valid();
+  }
+#endif
+
+ private:
+  TreeType tree_;
+};
+
+} // namespace sjtu
+
+#endif // SJTU_PERSISTENT_MAP_HPP_
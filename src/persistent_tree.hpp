@@ -0,0 +1,678 @@
+#ifndef SJTU_PERSISTENT_TREE_HPP_
+#define SJTU_PERSISTENT_TREE_HPP_
+
+#include "utility.hpp"
+#include "exceptions.hpp"
+#include "memory.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+namespace panic {
+
+/**
+ * A persistent red-black tree, allowing no duplicate keys:
+ * copies share their nodes, and a write copies only the
+ * nodes it changes, i.e. O(log n) of them, leaving the
+ * other copies as they were.
+ *
+ * The rebalancing is that of RbTree, done bottom-up, with
+ * these differences:
+ *
+ * - Nodes are reference counted, and have no parent
+ *   pointers, as a shared node has a parent in each tree it
+ *   is part of. Writes keep the path from the root in an
+ *   array instead.
+ * - Before a write changes a node, it makes the node belong
+ *   to this tree alone: a node is ours iff its parent is
+ *   ours and only that parent refers to it, so a node with
+ *   a count of 1 is changed in place, and a shared one is
+ *   copied, with its count and that of its children
+ *   adjusted. The root is ours if the tree is its only
+ *   holder. A tree that has never been copied thus writes
+ *   in place, like RbTree.
+ * - There is no end node, and iterators hold a node only:
+ *   stepping searches the tree for the neighbor, in
+ *   O(log n).
+ *
+ * The counts are atomic, so copies may be used and
+ * destroyed in different threads, as with std::shared_ptr;
+ * a single tree still needs external synchronization.
+ * Iterators are invalidated by writes to the tree, but not
+ * by writes to its copies.
+ */
+template <
+  typename ValueType,
+  typename Cmp,
+  typename Alloc = sjtu::allocator<ValueType>
+> class PersistentRbTree {
+ private:
+  class Node {
+   public:
+    enum Type { kRed, kBlack };
+    Node *left = nullptr;
+    Node *right = nullptr;
+    std::atomic<size_t> refs{1};
+    Type type = kRed;
+    ValueType value;
+
+    template <typename ...Args>
+    explicit Node (Args &&...args) : value(std::forward<Args>(args)...) {}
+    /// A copy of other sharing its children, which gain a reference.
+    Node (const Node &other)
+      : left(other.left), right(other.right), type(other.type), value(other.value) {
+      retain_(left);
+      retain_(right);
+    }
+  };
+  // a red-black tree of n nodes is at most 2 log2(n + 1) high;
+  // the erase fixup may push one more node on the path.
+  static constexpr size_t kMaxDepth_ = 2 * sizeof(size_t) * 8 + 2;
+ public:
+  using value_type = ValueType;
+  class const_iterator {
+   private:
+    const Node *node_ = nullptr;
+    const PersistentRbTree *home_ = nullptr;
+    friend class PersistentRbTree;
+   public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = const PersistentRbTree::value_type;
+    using pointer = value_type *;
+    using reference = value_type &;
+    using iterator_category = std::bidirectional_iterator_tag;
+
+    const_iterator () = default;
+    const_iterator (const Node *node, const PersistentRbTree *home) : node_(node), home_(home) {}
+    auto operator++ (int) -> const_iterator {
+      const_iterator retval = *this;
+      ++*this;
+      return retval;
+    }
+    auto operator++ () -> const_iterator & {
+      if (node_ == nullptr) throw sjtu::invalid_iterator();
+      node_ = home_->next_(node_);
+      return *this;
+    }
+    auto operator-- (int) -> const_iterator {
+      const_iterator retval = *this;
+      --*this;
+      return retval;
+    }
+    auto operator-- () -> const_iterator & {
+      if (home_ == nullptr) throw sjtu::invalid_iterator();
+      const Node *prev = node_ == nullptr ? max_(home_->root_) : home_->prev_(node_);
+      if (prev == nullptr) throw sjtu::invalid_iterator();
+      node_ = prev;
+      return *this;
+    }
+    auto operator* () const -> value_type & {
+      return node_->value;
+    }
+    auto operator== (const const_iterator &rhs) const -> bool {
+      return node_ == rhs.node_;
+    }
+    auto operator!= (const const_iterator &rhs) const -> bool {
+      return !(*this == rhs);
+    }
+
+    auto operator-> () const noexcept -> value_type * {
+      return &node_->value;
+    }
+  };
+
+  PersistentRbTree () = default;
+  explicit PersistentRbTree (const Alloc &alloc) : alloc_(alloc) {}
+  /**
+   * Shares the nodes of other, in O(1), if the allocators
+   * compare equal; copies them otherwise.
+   */
+  PersistentRbTree (const PersistentRbTree &other)
+    : alloc_(std::allocator_traits<Alloc>::select_on_container_copy_construction(other.get_allocator())) {
+    assign_(other);
+  }
+  ~PersistentRbTree () { release_(root_); }
+
+  auto operator= (const PersistentRbTree &other) -> PersistentRbTree & {
+    if (this == &other) return *this;
+    Node *old = root_;
+    size_t oldSize = size_;
+    if constexpr (std::allocator_traits<Alloc>::propagate_on_container_copy_assignment::value) {
+      // the old nodes must go back to the old allocator.
+      NodeAlloc_ oldAlloc = alloc_;
+      alloc_ = other.alloc_;
+      try {
+        assign_(other);
+      } catch (...) {
+        alloc_ = oldAlloc;
+        root_ = old;
+        size_ = oldSize;
+        throw;
+      }
+      releaseWith_(oldAlloc, old);
+    } else {
+      try {
+        assign_(other);
+      } catch (...) {
+        root_ = old;
+        size_ = oldSize;
+        throw;
+      }
+      release_(old);
+    }
+    return *this;
+  }
+  auto get_allocator () const -> Alloc {
+    return Alloc(alloc_);
+  }
+  auto begin () const -> const_iterator {
+    return const_iterator(min_(root_), this);
+  }
+  auto cbegin () const -> const_iterator {
+    return begin();
+  }
+  auto end () const -> const_iterator {
+    return const_iterator(nullptr, this);
+  }
+  auto cend () const -> const_iterator {
+    return end();
+  }
+  auto empty () const -> bool {
+    return root_ == nullptr;
+  }
+  auto size () const -> size_t {
+    return size_;
+  }
+  auto clear () -> void {
+    release_(root_);
+    root_ = nullptr;
+    size_ = 0;
+  }
+
+  /**
+   * Inserts value if there is no equivalent value yet,
+   *   copying the O(log n) nodes on the way that are shared.
+   * return a pair, the first of the pair is
+   *   the iterator to the new element (or the element that prevented the insertion),
+   *   the second one is true if insert successfully, or false.
+   */
+  auto insert (const ValueType &value) -> sjtu::pair<const_iterator, bool> {
+    if (const Node *found = find_(value); found != nullptr) {
+      return { const_iterator(found, this), false };
+    }
+    if (root_ == nullptr) {
+      root_ = newNode_(value);
+      root_->type = Node::kBlack;
+      size_ = 1;
+      return { const_iterator(root_, this), true };
+    }
+    Node *path[kMaxDepth_];
+    size_t depth = 0;
+    Node **slot = &root_;
+    // copying may throw, so every node to change is made
+    // ours before anything is changed.
+    while (*slot != nullptr) {
+      Node *parent = own_(*slot);
+      path[depth++] = parent;
+      slot = Cmp()(value, parent->value) ? &parent->left : &parent->right;
+    }
+    ownUncles_(path, depth);
+    Node *node = newNode_(value);
+    *slot = node;
+    ++size_;
+    fixupInsert_(path, depth, node);
+    root_->type = Node::kBlack;
+    return { const_iterator(node, this), true };
+  }
+  /**
+   * Returns the element with key equivalent to key, which
+   *   is what the value constructed from args must have,
+   *   inserting that value if there is none yet. Either way,
+   *   the element is made to belong to this tree alone, as
+   *   by edit, in a single descent.
+   * return a pair, the first of the pair is the element,
+   *   the second one is true if it was inserted, or false.
+   */
+  template <typename K, typename ...Args>
+  auto try_emplace (const K &key, Args &&...args) -> sjtu::pair<ValueType *, bool> {
+    if (root_ == nullptr) {
+      root_ = newNode_(std::forward<Args>(args)...);
+      root_->type = Node::kBlack;
+      size_ = 1;
+      return { &root_->value, true };
+    }
+    Node *path[kMaxDepth_];
+    size_t depth = 0;
+    Node **slot = &root_;
+    // as in insert, every node to change is made ours first.
+    while (*slot != nullptr) {
+      Node *parent = own_(*slot);
+      bool less = Cmp()(key, parent->value);
+      if (!less && !Cmp()(parent->value, key)) return { &parent->value, false };
+      path[depth++] = parent;
+      slot = less ? &parent->left : &parent->right;
+    }
+    ownUncles_(path, depth);
+    Node *node = newNode_(std::forward<Args>(args)...);
+    *slot = node;
+    ++size_;
+    fixupInsert_(path, depth, node);
+    root_->type = Node::kBlack;
+    return { &node->value, true };
+  }
+  /**
+   * Erases the element with key equivalent to key, if any.
+   * return the number of elements erased, 1 or 0.
+   */
+  template <typename K>
+  auto erase (const K &key) -> size_t {
+    if (find_(key) == nullptr) return 0;
+    Node *path[kMaxDepth_];
+    size_t depth = 0;
+    Node *node = own_(root_);
+    while (Cmp()(key, node->value) || Cmp()(node->value, key)) {
+      path[depth++] = node;
+      node = own_(Cmp()(key, node->value) ? node->left : node->right);
+    }
+    erase_(path, depth, node);
+    --size_;
+    return 1;
+  }
+  /**
+   * Returns the element with key equivalent to key, or
+   *   nullptr if there is none. The nodes on the way are
+   *   copied as needed, so that the element belongs to this
+   *   tree alone and may be modified, as long as its key is
+   *   left as it is.
+   */
+  template <typename K>
+  auto edit (const K &key) -> ValueType * {
+    if (find_(key) == nullptr) return nullptr;
+    Node *node = own_(root_);
+    while (Cmp()(key, node->value) || Cmp()(node->value, key)) {
+      node = own_(Cmp()(key, node->value) ? node->left : node->right);
+    }
+    return &node->value;
+  }
+
+  template <typename K>
+  auto find (const K &key) const -> const_iterator {
+    return const_iterator(find_(key), this);
+  }
+  /// The first element not less than key, or end().
+  template <typename K>
+  auto lower_bound (const K &key) const -> const_iterator {
+    return const_iterator(bound_<false>(key), this);
+  }
+  /// The first element greater than key, or end().
+  template <typename K>
+  auto upper_bound (const K &key) const -> const_iterator {
+    return const_iterator(bound_<true>(key), this);
+  }
+  template <typename K>
+  auto equal_range (const K &key) const -> sjtu::pair<const_iterator, const_iterator> {
+    return { lower_bound(key), upper_bound(key) };
+  }
+  /// Checks the colors, order, counts and size in O(n), for tests.
+  auto valid () const -> bool {
+    if (root_ != nullptr && root_->type != Node::kBlack) return false;
+    size_t count = 0;
+    return validSubtree_(root_, nullptr, nullptr, count) != 0 && count == size_;
+  }
+
+ private:
+  using NodeAlloc_ = typename std::allocator_traits<Alloc>::template rebind_alloc<Node>;
+  Node *root_ = nullptr;
+  size_t size_ = 0;
+  [[no_unique_address]] NodeAlloc_ alloc_;
+
+  static auto isBlack_ (const Node *node) -> bool {
+    return node == nullptr || node->type == Node::kBlack;
+  }
+  /**
+   * Checks the subtree under node, whose values must lie
+   * strictly between those of lo and hi where not null, and
+   * adds its size to count. Returns its black height, with
+   * the null leaves counted, or 0 if it is invalid.
+   */
+  static auto validSubtree_ (const Node *node, const Node *lo, const Node *hi, size_t &count) -> size_t {
+    if (node == nullptr) return 1;
+    Cmp cmp;
+    if (node->refs.load() == 0) return 0;
+    if (lo != nullptr && !cmp(lo->value, node->value)) return 0;
+    if (hi != nullptr && !cmp(node->value, hi->value)) return 0;
+    if (node->type == Node::kRed && !(isBlack_(node->left) && isBlack_(node->right))) return 0;
+    size_t left = validSubtree_(node->left, lo, node, count);
+    size_t right = validSubtree_(node->right, node, hi, count);
+    if (left == 0 || left != right) return 0;
+    ++count;
+    return left + (node->type == Node::kBlack ? 1 : 0);
+  }
+  static auto min_ (const Node *node) -> const Node * {
+    if (node == nullptr) return nullptr;
+    while (node->left != nullptr) node = node->left;
+    return node;
+  }
+  static auto max_ (const Node *node) -> const Node * {
+    if (node == nullptr) return nullptr;
+    while (node->right != nullptr) node = node->right;
+    return node;
+  }
+  /// The node after node, found from the root, or nullptr.
+  auto next_ (const Node *node) const -> const Node * {
+    return bound_<true>(node->value);
+  }
+  /// The node before node, found from the root, or nullptr.
+  auto prev_ (const Node *node) const -> const Node * {
+    const Node *result = nullptr;
+    for (const Node *cur = root_; cur != nullptr;) {
+      if (Cmp()(cur->value, node->value)) {
+        result = cur;
+        cur = cur->right;
+      } else {
+        cur = cur->left;
+      }
+    }
+    return result;
+  }
+  template <typename K>
+  auto find_ (const K &key) const -> const Node * {
+    const Node *node = root_;
+    while (node != nullptr) {
+      if (Cmp()(key, node->value)) {
+        node = node->left;
+      } else if (Cmp()(node->value, key)) {
+        node = node->right;
+      } else {
+        return node;
+      }
+    }
+    return nullptr;
+  }
+  /// The first node not less than (if !kUpper), or greater than (if kUpper), key.
+  template <bool kUpper, typename K>
+  auto bound_ (const K &key) const -> const Node * {
+    const Node *result = nullptr;
+    for (const Node *node = root_; node != nullptr;) {
+      bool goLeft;
+      if constexpr (kUpper) {
+        goLeft = Cmp()(key, node->value);
+      } else {
+        goLeft = !Cmp()(node->value, key);
+      }
+      if (goLeft) {
+        result = node;
+        node = node->left;
+      } else {
+        node = node->right;
+      }
+    }
+    return result;
+  }
+
+  template <typename ...Args>
+  auto newNode_ (Args &&...args) -> Node * {
+    return sjtu::internal::newObject<Node>(alloc_, std::forward<Args>(args)...);
+  }
+  static auto retain_ (Node *node) -> void {
+    if (node != nullptr) node->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+  auto release_ (Node *node) -> void {
+    releaseWith_(alloc_, node);
+  }
+  /// Drops a reference to node, freeing the nodes no tree refers to any more.
+  static auto releaseWith_ (NodeAlloc_ &alloc, Node *node) -> void {
+    while (node != nullptr && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      releaseWith_(alloc, node->left);
+      Node *right = node->right;
+      sjtu::internal::deleteObject(alloc, node);
+      node = right;
+    }
+  }
+  /**
+   * Makes the node in slot belong to this tree alone, by
+   * copying it if it is shared. The node holding slot must
+   * already be ours.
+   */
+  auto own_ (Node *&slot) -> Node * {
+    if (slot->refs.load(std::memory_order_acquire) != 1) {
+      Node *copy = newNode_(static_cast<const Node &>(*slot));
+      release_(slot);
+      slot = copy;
+    }
+    return slot;
+  }
+  /// Takes the nodes of other, or copies of them if the allocators differ.
+  auto assign_ (const PersistentRbTree &other) -> void {
+    if (alloc_ == other.alloc_) {
+      retain_(other.root_);
+      root_ = other.root_;
+    } else {
+      root_ = clone_(other.root_);
+    }
+    size_ = other.size_;
+  }
+  /// Deep-copies the subtree on alloc_.
+  auto clone_ (const Node *node) -> Node * {
+    if (node == nullptr) return nullptr;
+    Node *copy = newNode_(node->value);
+    copy->type = node->type;
+    try {
+      copy->left = clone_(node->left);
+      copy->right = clone_(node->right);
+    } catch (...) {
+      release_(copy);
+      throw;
+    }
+    return copy;
+  }
+
+  /// The slot holding path[i], given path[0 .. i].
+  auto slot_ (Node **path, size_t i) -> Node *& {
+    if (i == 0) return root_;
+    Node *parent = path[i - 1];
+    return parent->left == path[i] ? parent->left : parent->right;
+  }
+  /// Rotates the (owned) node in slot, and its (owned) right child, to the left.
+  static auto rotateLeft_ (Node *&slot) -> void {
+    Node *node = slot;
+    Node *child = node->right;
+    node->right = child->left;
+    child->left = node;
+    slot = child;
+  }
+  static auto rotateRight_ (Node *&slot) -> void {
+    Node *node = slot;
+    Node *child = node->left;
+    node->left = child->right;
+    child->right = node;
+    slot = child;
+  }
+
+  /// Makes ours, ahead of fixupInsert_, the red uncles it recolors.
+  auto ownUncles_ (Node **path, size_t depth) -> void {
+    for (; depth >= 2 && path[depth - 1]->type == Node::kRed; depth -= 2) {
+      Node *grandParent = path[depth - 2];
+      Node *&uncle = grandParent->left == path[depth - 1] ? grandParent->right : grandParent->left;
+      if (isBlack_(uncle)) return;
+      own_(uncle);
+    }
+  }
+  /**
+   * Performs fixups after node is inserted under path[0 ..
+   * depth), all of which are ours. It may leave the root
+   * red, which the caller must paint black.
+   */
+  auto fixupInsert_ (Node **path, size_t depth, Node *node) -> void {
+    while (depth > 0 && path[depth - 1]->type == Node::kRed) {
+      // a red parent is not the root, so there is a grandparent.
+      Node *parent = path[depth - 1];
+      Node *grandParent = path[depth - 2];
+      bool parentIsLeft = grandParent->left == parent;
+      Node *&uncle = parentIsLeft ? grandParent->right : grandParent->left;
+      if (!isBlack_(uncle)) {
+        own_(uncle)->type = Node::kBlack;
+        parent->type = Node::kBlack;
+        grandParent->type = Node::kRed;
+        node = grandParent;
+        depth -= 2;
+        continue;
+      }
+      if ((parent->left == node) != parentIsLeft) {
+        if (parentIsLeft) {
+          rotateLeft_(grandParent->left);
+        } else {
+          rotateRight_(grandParent->right);
+        }
+        parent = node;
+      }
+      parent->type = Node::kBlack;
+      grandParent->type = Node::kRed;
+      if (parentIsLeft) {
+        rotateRight_(slot_(path, depth - 2));
+      } else {
+        rotateLeft_(slot_(path, depth - 2));
+      }
+      return;
+    }
+  }
+
+  /**
+   * Unlinks and frees node, which is ours, as are its
+   * ancestors path[0 .. depth).
+   */
+  auto erase_ (Node **path, size_t depth, Node *node) -> void {
+    path[depth] = node;
+    size_t at = depth;
+    Node *succ = nullptr;
+    Node *child;
+    bool childIsLeft;
+    typename Node::Type removed;
+    // copying may throw, so every node to change is made
+    // ours before anything is changed.
+    if (node->left != nullptr && node->right != nullptr) {
+      // the successor takes the place and the color of node,
+      // and its own place is removed instead.
+      ++depth;
+      succ = own_(node->right);
+      while (succ->left != nullptr) {
+        path[depth++] = succ;
+        succ = own_(succ->left);
+      }
+      childIsLeft = depth - 1 != at;
+      removed = succ->type;
+      child = succ->right == nullptr ? nullptr : own_(succ->right);
+    } else {
+      childIsLeft = depth > 0 && path[depth - 1]->left == node;
+      removed = node->type;
+      child = node->left != nullptr ? own_(node->left) : node->right != nullptr ? own_(node->right) : nullptr;
+    }
+    if (removed == Node::kBlack && isBlack_(child)) ownSiblings_(path, depth, childIsLeft);
+
+    if (succ != nullptr) {
+      if (childIsLeft) {
+        path[depth - 1]->left = child;
+        succ->right = node->right;
+      }
+      succ->left = node->left;
+      succ->type = node->type;
+      slot_(path, at) = succ;
+      path[at] = succ;
+    } else {
+      slot_(path, at) = child;
+    }
+    node->left = nullptr;
+    node->right = nullptr;
+    release_(node);
+    if (removed == Node::kBlack) fixupErase_(path, depth, child, childIsLeft);
+  }
+  /**
+   * Makes ours, ahead of fixupErase_, the siblings and
+   * nephews it may recolor or rotate, up to where it stops.
+   * It then copies nothing, and cannot throw halfway.
+   */
+  auto ownSiblings_ (Node **path, size_t depth, bool childIsLeft) -> void {
+    while (depth > 0) {
+      Node *parent = path[depth - 1];
+      Node *sibling = own_(childIsLeft ? parent->right : parent->left);
+      ownChildren_(sibling);
+      if (sibling->type == Node::kRed) {
+        // it is rotated up, and its near child becomes the sibling.
+        ownChildren_(childIsLeft ? sibling->left : sibling->right);
+        return;
+      }
+      if (!isBlack_(sibling->left) || !isBlack_(sibling->right)) return;
+      if (parent->type == Node::kRed) return;
+      --depth;
+      childIsLeft = depth > 0 && path[depth - 1]->left == parent;
+    }
+  }
+  auto ownChildren_ (Node *node) -> void {
+    if (node->left != nullptr) own_(node->left);
+    if (node->right != nullptr) own_(node->right);
+  }
+  /**
+   * Performs fixups after a black node is removed, leaving
+   * child, one black short, under path[0 .. depth), all of
+   * which are ours, on the side given by childIsLeft.
+   */
+  auto fixupErase_ (Node **path, size_t depth, Node *child, bool childIsLeft) -> void {
+    while (depth > 0 && isBlack_(child)) {
+      Node *parent = path[depth - 1];
+      // the missing black means the sibling is there.
+      Node *sibling = own_(childIsLeft ? parent->right : parent->left);
+      if (sibling->type == Node::kRed) {
+        sibling->type = Node::kBlack;
+        parent->type = Node::kRed;
+        if (childIsLeft) {
+          rotateLeft_(slot_(path, depth - 1));
+        } else {
+          rotateRight_(slot_(path, depth - 1));
+        }
+        path[depth - 1] = sibling;
+        path[depth++] = parent;
+        sibling = own_(childIsLeft ? parent->right : parent->left);
+      }
+      if (isBlack_(sibling->left) && isBlack_(sibling->right)) {
+        sibling->type = Node::kRed;
+        child = parent;
+        --depth;
+        childIsLeft = depth > 0 && path[depth - 1]->left == child;
+        continue;
+      }
+      Node *&far = childIsLeft ? sibling->right : sibling->left;
+      if (isBlack_(far)) {
+        Node *&near = childIsLeft ? sibling->left : sibling->right;
+        own_(near)->type = Node::kBlack;
+        sibling->type = Node::kRed;
+        if (childIsLeft) {
+          rotateRight_(parent->right);
+        } else {
+          rotateLeft_(parent->left);
+        }
+        sibling = childIsLeft ? parent->right : parent->left;
+      }
+      sibling->type = parent->type;
+      parent->type = Node::kBlack;
+      own_(childIsLeft ? sibling->right : sibling->left)->type = Node::kBlack;
+      if (childIsLeft) {
+        rotateLeft_(slot_(path, depth - 1));
+      } else {
+        rotateRight_(slot_(path, depth - 1));
+      }
+      return;
+    }
+    if (child == nullptr) return;
+    // a red child may be shared, unlike a parent on the path.
+    Node *&slot = depth == 0 ? root_ : childIsLeft ? path[depth - 1]->left : path[depth - 1]->right;
+    own_(slot)->type = Node::kBlack;
+  }
+};
+
+} // namespace panic
+
+#endif // SJTU_PERSISTENT_TREE_HPP_
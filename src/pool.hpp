@@ -0,0 +1,183 @@
+#ifndef SJTU_POOL_HPP_
+#define SJTU_POOL_HPP_
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "memory.hpp"
+#include "vector.hpp"
+
+namespace panic {
+
+/**
+ * A slab allocator for objects of a single type, e.g. tree
+ * nodes. Memory is taken from Alloc in chunks of growing
+ * sizes, carved out one object at a time, and reused
+ * through a free list. Nothing is given back to Alloc until
+ * release(), which frees all the chunks at once.
+ *
+ * The pool only deals with memory; constructing and
+ * destructing the objects is up to the caller.
+ *
+ * Objects may move between pools, e.g. when trees are
+ * split or joined: after share(), a pool keeps the chunks
+ * of the other alive, which are freed only when the last
+ * pool using them lets go. Pools never touch each other's
+ * free lists, so they may still be used independently.
+ */
+template <typename T, typename Alloc>
+class NodePool {
+ private:
+  union Slot {
+    Slot *next;
+    alignas(T) char value[sizeof(T)];
+  };
+  class Chunk {
+   public:
+    Slot *slots;
+    size_t size;
+  };
+  using SlotAlloc_ = typename std::allocator_traits<Alloc>::template rebind_alloc<Slot>;
+  using SlotTraits_ = std::allocator_traits<SlotAlloc_>;
+  using ChunkAlloc_ = typename std::allocator_traits<Alloc>::template rebind_alloc<Chunk>;
+  /// A set of chunks, freed when the last pool using it lets go.
+  class Arena {
+   public:
+    explicit Arena (const SlotAlloc_ &alloc) : alloc(alloc), chunks(ChunkAlloc_(alloc)) {}
+    Arena (const Arena &) = delete;
+    auto operator= (const Arena &) -> Arena & = delete;
+    ~Arena () {
+      for (auto &chunk : chunks) SlotTraits_::deallocate(alloc, chunk.slots, chunk.size);
+    }
+    [[no_unique_address]] SlotAlloc_ alloc;
+    sjtu::vector<Chunk, sjtu::doubling_growth, ChunkAlloc_> chunks;
+  };
+  using ArenaPtr_ = std::shared_ptr<Arena>;
+  using ArenaPtrAlloc_ = typename std::allocator_traits<Alloc>::template rebind_alloc<ArenaPtr_>;
+ public:
+  NodePool () = default;
+  explicit NodePool (const Alloc &alloc) : alloc_(alloc), borrowed_(ArenaPtrAlloc_(alloc)) {}
+  NodePool (const NodePool &) = delete;
+  auto operator= (const NodePool &) -> NodePool & = delete;
+  ~NodePool () { release(); }
+
+  /// Takes memory for one object.
+  auto allocate () -> T * {
+    if (free_ != nullptr) {
+      Slot *slot = free_;
+      free_ = slot->next;
+      return reinterpret_cast<T *>(slot);
+    }
+    if (cursor_ == end_) {
+      if (spare_ != nullptr) {
+        Slot *slot = spare_;
+        spare_ = slot->next;
+        return reinterpret_cast<T *>(slot);
+      }
+      addChunk_(nextChunkSize_());
+    }
+    return reinterpret_cast<T *>(cursor_++);
+  }
+  /// Puts the memory of an object, already destructed, to the free list.
+  auto deallocate (T *p) noexcept -> void {
+    auto *slot = reinterpret_cast<Slot *>(p);
+    slot->next = free_;
+    free_ = slot;
+  }
+  /**
+   * Makes room for n objects in one contiguous run, which
+   * allocate() hands out in order once the free list is
+   * exhausted. What was left of the previous run is only
+   * handed out after this one.
+   */
+  auto reserve (size_t n) -> void {
+    if (static_cast<size_t>(end_ - cursor_) < n) addChunk_(n);
+  }
+  /**
+   * Keeps the memory of other alive as long as this pool
+   * is, so that objects allocated by other may be handed
+   * over to, and deallocated by, this pool. The pool does
+   * not know which objects live where, so the chunks shared
+   * are kept until release(), even once no object of this
+   * pool is left in them. Sharing the same memory again
+   * keeps nothing more, but takes O(a) per arena for the a
+   * arenas this pool keeps already.
+   */
+  auto share (const NodePool &other) -> void {
+    borrow_(other.own_);
+    for (const auto &arena : other.borrowed_) borrow_(arena);
+  }
+  /// Exchanges the memory of the pools, whose allocators must be equal.
+  auto swap (NodePool &other) noexcept -> void {
+    std::swap(own_, other.own_);
+    std::swap(borrowed_, other.borrowed_);
+    std::swap(free_, other.free_);
+    std::swap(spare_, other.spare_);
+    std::swap(cursor_, other.cursor_);
+    std::swap(end_, other.end_);
+  }
+  /**
+   * Frees all the memory at once, live objects or not,
+   * unless it is still shared with other pools.
+   */
+  auto release () noexcept -> void {
+    own_.reset();
+    borrowed_.clear();
+    free_ = spare_ = cursor_ = end_ = nullptr;
+  }
+  auto get_allocator () const -> Alloc {
+    return Alloc(alloc_);
+  }
+
+ private:
+  static constexpr size_t kMinChunk_ = 16;
+  static constexpr size_t kMaxChunk_ = 4096;
+  [[no_unique_address]] SlotAlloc_ alloc_;
+  // where new chunks go; created on demand.
+  ArenaPtr_ own_;
+  // arenas of other pools, which objects here may come from.
+  sjtu::vector<ArenaPtr_, sjtu::doubling_growth, ArenaPtrAlloc_> borrowed_;
+  Slot *free_ = nullptr;
+  // the rests of earlier chunks, used once the current one is.
+  Slot *spare_ = nullptr;
+  // the untouched part of the last chunk.
+  Slot *cursor_ = nullptr;
+  Slot *end_ = nullptr;
+
+  auto nextChunkSize_ () const -> size_t {
+    if (own_ == nullptr || own_->chunks.empty()) return kMinChunk_;
+    size_t size = own_->chunks.back().size * 2;
+    return size > kMaxChunk_ ? kMaxChunk_ : size;
+  }
+  auto addChunk_ (size_t n) -> void {
+    if (own_ == nullptr) own_ = std::allocate_shared<Arena>(alloc_, alloc_);
+    Slot *slots = SlotTraits_::allocate(alloc_, n);
+    try {
+      own_->chunks.push_back(Chunk { slots, n });
+    } catch (...) {
+      SlotTraits_::deallocate(alloc_, slots, n);
+      throw;
+    }
+    // the rest of the old chunk is not wasted, but it comes
+    // after the new one, which may be a reserved run.
+    while (end_ != cursor_) {
+      --end_;
+      end_->next = spare_;
+      spare_ = end_;
+    }
+    cursor_ = slots;
+    end_ = slots + n;
+  }
+  auto borrow_ (const ArenaPtr_ &arena) -> void {
+    if (arena == nullptr || arena == own_) return;
+    for (const auto &borrowed : borrowed_) {
+      if (borrowed == arena) return;
+    }
+    borrowed_.push_back(arena);
+  }
+};
+
+} // namespace panic
+
+#endif // SJTU_POOL_HPP_
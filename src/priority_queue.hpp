@@ -3,7 +3,9 @@
 
 #include <cstddef>
 #include <functional>
+#include <memory>
 #include "exceptions.hpp"
+#include "memory.hpp"
 
 #ifdef DEBUG
 #include <iostream>
@@ -14,7 +16,8 @@
 
 namespace panic {
 
-template <typename T, class Compare = std::less<T>>
+/// Nodes are allocated from Alloc rebound to the node type.
+template <typename T, class Compare = std::less<T>, class Alloc = sjtu::allocator<T>>
 class PairingHeap {
  public:
   struct Node {
@@ -23,25 +26,41 @@ class PairingHeap {
     Node *neighbor = nullptr;
 
     Node (const T &value) : value(value) {}
-    Node (const Node &other) : value(other.value) {
-      // _log("PairingHeap::Node::Node(const Node&)");
-      if (other.firstChild != nullptr) firstChild = new Node(*other.firstChild);
-      if (other.neighbor != nullptr) neighbor = new Node(*other.neighbor);
-    }
-    auto destroy () -> void {
-      if (firstChild != nullptr) {
-        firstChild->destroy();
-        delete firstChild;
-      }
-      if (neighbor != nullptr) {
-        neighbor->destroy();
-        delete neighbor;
-      }
-    }
   };
+  using NodeAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Node>;
 
   Compare less;
   Node *root = nullptr;
+  [[no_unique_address]] NodeAlloc alloc;
+
+  auto newNode (const T &value) -> Node * {
+    return sjtu::internal::newObject<Node>(alloc, value);
+  }
+  auto deleteNode (Node *node) -> void {
+    sjtu::internal::deleteObject(alloc, node);
+  }
+  /// deletes the node, its children and its following neighbors.
+  auto destroy (Node *node) -> void {
+    if (node->firstChild != nullptr) destroy(node->firstChild);
+    if (node->neighbor != nullptr) destroy(node->neighbor);
+    deleteNode(node);
+  }
+  /**
+   * clones the node, its children and its following neighbors.
+   * on failure, the partial clone is deleted.
+   */
+  auto clone (const Node *node) -> Node * {
+    // _log("PairingHeap::clone");
+    Node *newNode = this->newNode(node->value);
+    try {
+      if (node->firstChild != nullptr) newNode->firstChild = clone(node->firstChild);
+      if (node->neighbor != nullptr) newNode->neighbor = clone(node->neighbor);
+    } catch (...) {
+      destroy(newNode);
+      throw;
+    }
+    return newNode;
+  }
 
   /// merges two trees and returns the new root.
   auto mergeRoots (Node *a, Node *b) -> Node * {
@@ -66,19 +85,21 @@ class PairingHeap {
   }
 
   PairingHeap () = default;
-  PairingHeap (const PairingHeap &other) { *this = other; }
+  explicit PairingHeap (const Alloc &alloc) : alloc(alloc) {}
+  PairingHeap (const PairingHeap &other)
+    : alloc(std::allocator_traits<NodeAlloc>::select_on_container_copy_construction(other.alloc)) {
+    *this = other;
+  }
   ~PairingHeap () {
-    if (root != nullptr) root->destroy();
-    delete root;
+    if (root != nullptr) destroy(root);
   }
   auto operator= (const PairingHeap &other) -> PairingHeap & {
     if (this == &other) return *this;
     if (root != nullptr) {
-      root->destroy();
-      delete root;
+      destroy(root);
       root = nullptr;
     }
-    if (other.root != nullptr) root = new Node(*other.root);
+    if (other.root != nullptr) root = clone(other.root);
     return *this;
   }
 };
@@ -87,10 +108,11 @@ class PairingHeap {
 
 namespace sjtu {
 
-template <typename T, class Compare = std::less<T>>
+template <typename T, class Compare = std::less<T>, class Allocator = allocator<T>>
 class priority_queue {
  public:
   priority_queue () = default;
+  explicit priority_queue (const Allocator &alloc) : heap_(alloc) {}
   /**
    * get the top of the queue.
    * @return a reference of the top element.
@@ -102,7 +124,7 @@ class priority_queue {
   }
   /// push new element to the priority queue.
   auto push (const T &value) -> void {
-    Node *newNode = new Node(value);
+    Node *newNode = heap_.newNode(value);
     heap_.root = heap_.mergeRoots(heap_.root, newNode);
     ++size_;
   }
@@ -113,7 +135,7 @@ class priority_queue {
   auto pop () -> void {
     if (empty()) throw container_is_empty();
     Node *firstChild = heap_.root->firstChild;
-    delete heap_.root;
+    heap_.deleteNode(heap_.root);
     heap_.root = heap_.mergeChildren(firstChild);
     --size_;
   }
@@ -127,16 +149,28 @@ class priority_queue {
   /**
    * merge two priority_queues with at ~~least~~ most O(logn) complexity.
    * clear the other priority_queue.
+   * if copying or comparing throws, neither queue is changed.
    */
   auto merge (priority_queue &other) -> void {
+    if (this == &other) return;
+    Node *otherRoot = other.heap_.root;
+    // we could not free nodes from another allocator, so copy them over.
+    bool copied = otherRoot != nullptr && heap_.alloc != other.heap_.alloc;
+    if (copied) otherRoot = heap_.clone(otherRoot);
+    try {
+      heap_.root = heap_.mergeRoots(heap_.root, otherRoot);
+    } catch (...) {
+      if (copied) heap_.destroy(otherRoot);
+      throw;
+    }
+    if (copied) other.heap_.destroy(other.heap_.root);
+    other.heap_.root = nullptr;
     size_ += other.size_;
     other.size_ = 0;
-    heap_.root = heap_.mergeRoots(heap_.root, other.heap_.root);
-    other.heap_.root = nullptr;
   }
 
  private:
-  using Heap = panic::PairingHeap<T, Compare>;
+  using Heap = panic::PairingHeap<T, Compare, Allocator>;
   using Node = typename Heap::Node;
   Heap heap_;
   size_t size_ = 0;
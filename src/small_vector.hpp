@@ -0,0 +1,32 @@
+#ifndef SJTU_SMALL_VECTOR_HPP
+#define SJTU_SMALL_VECTOR_HPP
+
+#include "vector.hpp"
+
+#include <cstddef>
+
+namespace sjtu {
+
+/**
+ * a vector which keeps up to N elements inside the object
+ * itself, and only spills to the heap beyond that. It shares
+ * the whole interface of vector; use it for short-lived
+ * vectors that are usually small, so that filling them does
+ * not allocate at all.
+ *
+ * Moving a small_vector whose elements are still inline
+ * moves the elements one by one instead of stealing a
+ * buffer, so it costs O(size()) rather than O(1).
+ */
+template <
+  typename T,
+  size_t N,
+  typename Growth = doubling_growth,
+  typename Allocator = allocator<T>,
+  typename Access = default_access
+>
+using small_vector = vector<T, Growth, Allocator, N, Access>;
+
+} // namespace sjtu
+
+#endif
@@ -3,8 +3,20 @@
 
 #include "utility.hpp"
 #include "exceptions.hpp"
+#include "memory.hpp"
+#include "pool.hpp"
+#include "vector.hpp"
 #include "type_traits.hpp"
 
+#include <algorithm>
+#include <cstdint>
+#include <future>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+
 namespace panic {
 
 class nullopt {};
@@ -14,7 +26,7 @@ class Optional {
  public:
   bool has = false;
  private:
-  char value_[sizeof(T)];
+  alignas(T) char value_[sizeof(T)];
   auto ptr_ () -> T * { return reinterpret_cast<T *>(value_); }
   auto ptr_ () const -> const T * { return reinterpret_cast<const T *>(value_); }
   auto clear_ () -> void {
@@ -56,6 +68,19 @@ class Optional<T *> {
   auto force () const -> T * const & { return value_; }
 };
 
+/**
+ * The order-statistics augmentation of tree nodes: the
+ * number of nodes in the subtree rooted here. It is empty
+ * unless enabled, so that plain trees pay nothing for it.
+ */
+template <bool kEnabled>
+class SubtreeSize {
+ public:
+  size_t count = 1;
+};
+template <>
+class SubtreeSize<false> {};
+
 /**
  * An implementation of the red-black tree, allowing no
  * duplicate keys.
@@ -71,17 +96,34 @@ class Optional<T *> {
  *   smaller subset in libc++ and libstdc++. This design
  *   offers a great reduction in class hierachy (so we don't
  *   need __parent_unsafe()'s), at the expense of slightly
- *   more memory consumption.
- * - We use tail recursions when possible for better code
- *   readability without sacrificing efficiency (when we
- *   have -O1 or above).
+ *   more memory consumption. Its value is never
+ *   constructed, so nodes need not know if they have one.
+ * - Like libstdc++'s, a node stores its color in the
+ *   parent pointer; see Node.
+ * - We use tail recursions in the rebalancing fixups for
+ *   better code readability; their depth is bounded by the
+ *   tree height anyway. Lookups, copies and teardown, which
+ *   walk the whole tree or run the hottest, are loops, so
+ *   that neither speed nor stack usage depends on the
+ *   optimization level.
  * - We make abstractions over common patterns in the
  *   original algorithms, e.g. isLeft.
  *
  * The overall structure is based on libc++'s.
+ *
+ * Nodes, including the end node, live in a NodePool on
+ * memory from Alloc, so that they are packed together and
+ * the whole tree is freed at once on clear() or destruction.
+ *
+ * If kRanked is set, every node also tracks the size of its
+ * subtree, which enables nth() and rank() in O(log n).
  */
-template <typename ValueType, typename Cmp>
-class RbTree {
+template <
+  typename ValueType,
+  typename Cmp,
+  typename Alloc = sjtu::allocator<ValueType>,
+  bool kRanked = false
+> class RbTree {
  private:
   using Pointer = ValueType *;
   class Node;
@@ -146,7 +188,7 @@ class RbTree {
       return *this;
     }
     auto operator* () const -> value_type & {
-      return node_->value.force();
+      return node_->value();
     }
     auto operator== (const iterator &rhs) const -> bool {
       return node_ == rhs.node_;
@@ -162,7 +204,7 @@ class RbTree {
     }
 
     auto operator-> () const noexcept -> value_type * {
-      return &node_->value.force();
+      return &node_->value();
     }
   };
   class const_iterator {
@@ -203,7 +245,7 @@ class RbTree {
       return *this;
     }
     auto operator* () const -> value_type & {
-      return node_->value.force();
+      return node_->value();
     }
     auto operator== (const const_iterator &rhs) const -> bool {
       return node_ == rhs.node_;
@@ -219,21 +261,69 @@ class RbTree {
     }
 
     auto operator-> () const noexcept -> value_type * {
-      return &node_->value.force();
+      return &node_->value();
     }
   };
 
   RbTree () { init_(); }
-  RbTree (const RbTree &other) { *this = other; }
+  explicit RbTree (const Alloc &alloc) : pool_(alloc) { init_(); }
+  /**
+   * Builds the tree from the values in [first, last) in one
+   * go, keeping the first of equivalent values. It takes
+   * O(n) if the range is sorted without duplicates, and
+   * O(n log n) otherwise; no rebalancing is ever done.
+   */
+  template <typename InputIt>
+  RbTree (InputIt first, InputIt last, const Alloc &alloc = Alloc()) : pool_(alloc) {
+    using Category = typename std::iterator_traits<InputIt>::iterator_category;
+    // one run for the end node and all the values, in order.
+    if constexpr (std::is_base_of_v<std::forward_iterator_tag, Category>) {
+      pool_.reserve(std::distance(first, last) + 1);
+    }
+    init_();
+    build_(first, last);
+  }
+  RbTree (const RbTree &other)
+    : pool_(std::allocator_traits<Alloc>::select_on_container_copy_construction(other.get_allocator())) {
+    *this = other;
+  }
   ~RbTree () { destroy_(); }
 
   auto operator= (const RbTree &other) -> RbTree & {
-    if (this == &other) return *this;
+    assign(other);
+    return *this;
+  }
+  /**
+   * Replaces the values with copies of those of other. The
+   * copy is built aside, on a pool of its own, and only
+   * then replaces the values, so that nothing changes if
+   * copying throws. With more than one thread, the two
+   * halves of large subtrees are copied at once, on up to
+   * threads threads, each into a pool of its own whose
+   * memory the copy then shares.
+   */
+  auto assign (const RbTree &other, size_t threads = 1) -> void {
+    if (this == &other) return;
+    size_t size = other.size();
+    NodePool<Node, Alloc> pool(get_allocator());
+    // one run for the end node and all the values, unless
+    // other threads allocate most of them.
+    pool.reserve(threads <= 1 ? size + 1 : 1);
+    Node *endNode = new(pool.allocate()) Node;
+    if (other.root_() != nullptr) {
+      endNode->left = threads <= 1
+        ? clone_(pool, other.root_(), endNode)
+        : cloneParallel_(pool, other.root_(), endNode, blackHeight_(other.root_()), threads);
+    }
     destroy_();
-    size_ = other.size_;
-    endNode_ = other.endNode_->clone(nullptr);
+    pool_.swap(pool);
+    endNode_ = endNode;
+    size_ = size;
     leftmost_ = endNode_->min();
-    return *this;
+    rightmost_ = root_() == nullptr ? endNode_ : root_()->max();
+  }
+  auto get_allocator () const -> Alloc {
+    return pool_.get_allocator();
   }
   auto begin () -> iterator {
     return iterator(leftmost_, this);
@@ -248,7 +338,7 @@ class RbTree {
     return const_iterator(endNode_, this);
   }
   auto empty () const -> bool {
-    return size_ == 0;
+    return root_() == nullptr;
   }
   auto size () const -> size_t {
     return size_;
@@ -258,16 +348,118 @@ class RbTree {
     init_();
   }
   auto insert (const value_type &value) -> sjtu::pair<iterator, bool> {
-    auto res = emplace_(value);
+    return try_emplace(value, value);
+  }
+  /**
+   * Inserts a value constructed from args if there is no
+   * value equivalent to key, which is what it must be
+   * equivalent to. Nothing is constructed otherwise.
+   */
+  template <typename K, typename ...Args>
+  auto try_emplace (const K &key, Args &&...args) -> sjtu::pair<iterator, bool> {
+    auto res = emplace_(key, std::forward<Args>(args)...);
     if (!res.has) ++size_;
     return sjtu::pair(iterator(res.force(), this), !res.has);
   }
+  /**
+   * Inserts value, searching around hint first: amortized
+   * O(1) if value goes right before or right after hint.
+   */
+  auto insert (const_iterator hint, const value_type &value) -> iterator {
+    if (hint.home_ != this) throw sjtu::invalid_iterator();
+    auto res = emplaceNear_(hint.node_, value);
+    if (!res.has) ++size_;
+    return iterator(res.force(), this);
+  }
+  /**
+   * Constructs a value from args in a new node, and inserts
+   * it like insert(hint, value) if there is no equivalent
+   * value; otherwise the node is destroyed again.
+   */
+  template <typename ...Args>
+  auto emplace_hint (const_iterator hint, Args &&...args) -> iterator {
+    if (hint.home_ != this) throw sjtu::invalid_iterator();
+    Node *node = newNode_(std::forward<Args>(args)...);
+    Slot slot { endNode_, true };
+    try {
+      if (root_() != nullptr) {
+        Node *dup = findSlotNear_(hint.node_, node->value(), slot);
+        if (dup != nullptr) {
+          deleteNode_(node);
+          return iterator(dup, this);
+        }
+      }
+    } catch (...) {
+      deleteNode_(node);
+      throw;
+    }
+    attachNode_(slot, node);
+    ++size_;
+    return iterator(node, this);
+  }
   auto erase (iterator pos) -> void {
     if (pos.node_ == endNode_ || pos.home_ != this) throw sjtu::invalid_iterator();
     delete_(pos.node_);
-    delete pos.node_;
+    deleteNode_(pos.node_);
     --size_;
   }
+  /**
+   * Erases the values in [first, last), and returns last.
+   * A short range is erased value by value; a longer one is
+   * cut out with two splits and a join, in O(log n + k) for
+   * k values, with no rebalancing per value.
+   */
+  auto erase (const_iterator first, const_iterator last) -> iterator {
+    if (first.home_ != this || last.home_ != this) throw sjtu::invalid_iterator();
+    if (first == last) return iterator(last.node_, this);
+    if (first.node_ == endNode_ ||
+        (last.node_ != endNode_ && Cmp()(last.node_->value(), first.node_->value()))) {
+      throw sjtu::invalid_iterator();
+    }
+    Node *node = first.node_;
+    size_t count = 0;
+    for (; node != last.node_ && count < kEraseCutoff_; node = node->next()) ++count;
+    if (node != last.node_) {
+      eraseRange_(first.node_, last.node_);
+      return iterator(last.node_, this);
+    }
+    for (node = first.node_; node != last.node_;) {
+      Node *next = node->next();
+      delete_(node);
+      deleteNode_(node);
+      node = next;
+    }
+    size_ -= count;
+    return iterator(last.node_, this);
+  }
+  /**
+   * Erases the values for which pred returns true, and
+   * returns how many. pred sees every value before anything
+   * is erased, so if it throws, nothing is. Many erasures
+   * are done as one rebuild of the remaining nodes into a
+   * balanced tree, in O(n), with no rebalancing per value.
+   */
+  template <typename Pred>
+  auto erase_if (Pred pred) -> size_t {
+    sjtu::vector<Node *> kept;
+    sjtu::vector<Node *> doomed;
+    for (Node *node = leftmost_; node != endNode_; node = node->next()) {
+      (pred(static_cast<const ValueType &>(node->value())) ? doomed : kept).push_back(node);
+    }
+    size_t count = doomed.size();
+    if (count <= kEraseCutoff_) {
+      for (Node *node : doomed) {
+        delete_(node);
+        deleteNode_(node);
+      }
+      size_ -= count;
+      return count;
+    }
+    for (Node *node : doomed) deleteNode_(node);
+    Node **next = kept.empty() ? nullptr : &kept[0];
+    relink_([&] { return *next++; }, kept.size());
+    return count;
+  }
   template <typename K>
   auto find (const K &key) -> iterator {
     if (empty()) return end();
@@ -282,104 +474,292 @@ class RbTree {
     if (!node.has) return cend();
     return const_iterator(node.force(), this);
   }
+  /// The first element not less than key, or end().
+  template <typename K>
+  auto lower_bound (const K &key) -> iterator {
+    return iterator(bound_<false>(key), this);
+  }
+  template <typename K>
+  auto lower_bound (const K &key) const -> const_iterator {
+    return const_iterator(bound_<false>(key), this);
+  }
+  /// The first element greater than key, or end().
+  template <typename K>
+  auto upper_bound (const K &key) -> iterator {
+    return iterator(bound_<true>(key), this);
+  }
+  template <typename K>
+  auto upper_bound (const K &key) const -> const_iterator {
+    return const_iterator(bound_<true>(key), this);
+  }
+  /// The range of elements equivalent to key.
+  template <typename K>
+  auto equal_range (const K &key) -> sjtu::pair<iterator, iterator> {
+    return sjtu::pair(lower_bound(key), upper_bound(key));
+  }
+  template <typename K>
+  auto equal_range (const K &key) const -> sjtu::pair<const_iterator, const_iterator> {
+    return sjtu::pair(lower_bound(key), upper_bound(key));
+  }
+  /**
+   * Moves the values not less than key into rest, whose
+   * previous contents are discarded. The nodes are moved,
+   * not copied, in O(log n); rest shares the node memory of
+   * this tree from then on. Unless the tree is ranked, the
+   * smaller part is then counted, for O(log n + k) in all
+   * for k values in it. Iterators to the moved values are
+   * invalidated.
+   */
+  template <typename K>
+  auto split (const K &key, RbTree &rest) -> void {
+    if (&rest == this) return;
+    rest.clear();
+    rest.pool_.share(pool_);
+    Node *root = root_();
+    if (root == nullptr) return;
+    size_t size = size_;
+    root->setParent(nullptr);
+    auto [ left, right ] = split_({ root, blackHeight_(root) }, key);
+    resetRoot_(left.root, 0);
+    rest.resetRoot_(right.root, 0);
+    if constexpr (!kRanked) {
+      // one value of each in turn, until either runs out.
+      size_t count = 0;
+      Node *mine = leftmost_;
+      Node *theirs = rest.leftmost_;
+      for (; mine != endNode_ && theirs != rest.endNode_; ++count) {
+        mine = mine->next();
+        theirs = theirs->next();
+      }
+      size_ = mine == endNode_ ? count : size - count;
+      rest.size_ = size - size_;
+    }
+  }
+  /**
+   * Moves all the values of other into this tree. The two
+   * trees must not interleave, i.e. all the values in other
+   * are less than, or all greater than, those in this tree;
+   * otherwise runtime_error is thrown and nothing happens.
+   * It takes O(log n) if the allocators are equal, as the
+   * nodes are moved, and O(m log(n + m)) otherwise.
+   * Iterators to the values of other are invalidated.
+   */
+  auto join (RbTree &other) -> void {
+    if (&other == this || other.empty()) return;
+    Cmp cmp;
+    Node *otherMax = other.rightmost_;
+    bool after = empty() || cmp(rightmost_->value(), other.leftmost_->value());
+    if (!after && !cmp(otherMax->value(), leftmost_->value())) {
+      throw sjtu::runtime_error();
+    }
+    if (!(get_allocator() == other.get_allocator())) {
+      for (auto it = other.cbegin(); it != other.cend(); ++it) insert(*it);
+      other.clear();
+      return;
+    }
+    pool_.share(other.pool_);
+    size_t size = size_ + other.size_;
+    // the value of other next to this tree joins the two.
+    Node *pivot = after ? other.leftmost_ : otherMax;
+    other.delete_(pivot);
+    Subtree mine = detach_(root_());
+    Subtree theirs = detach_(other.root_());
+    other.resetRoot_(nullptr, 0);
+    Subtree joined = after ? join_(mine, pivot, theirs) : join_(theirs, pivot, mine);
+    resetRoot_(joined.root, size);
+  }
+  /**
+   * Moves the values of other that have no equivalent in
+   * this tree into it; the others stay in other. It takes
+   * O(m log(n / m + 1)) for trees of sizes m <= n, as the
+   * nodes are moved by splits and joins, if the allocators
+   * are equal, and O(m log(n + m)) otherwise. The halves of
+   * the divide and conquer are run on up to threads threads.
+   */
+  auto merge (RbTree &other, size_t threads = 1) -> void {
+    if (&other == this || other.empty()) return;
+    if (!(get_allocator() == other.get_allocator())) {
+      for (Node *node = other.leftmost_; node != other.endNode_;) {
+        Node *next = node->next();
+        if (insert(node->value()).second) other.erase(iterator(node, &other));
+        node = next;
+      }
+      return;
+    }
+    pool_.share(other.pool_);
+    size_t size = size_ + other.size_;
+    Subtree mine = detach_(root_());
+    Subtree theirs = detach_(other.root_());
+    auto [ merged, duplicates ] = union_(mine, theirs, threads);
+    resetRoot_(merged.root, size - duplicates.size);
+    other.resetRoot_(nullptr, 0);
+    Node *chain = duplicates.head;
+    other.relink_([&] {
+      Node *node = chain;
+      chain = node->parent();
+      return node;
+    }, duplicates.size);
+  }
+  /**
+   * Erases the values that have no equivalent in other.
+   * It takes O(m log(n / m + 1)) for trees of sizes m <= n,
+   * plus O(1) per value erased, on up to threads threads.
+   */
+  auto intersect (const RbTree &other, size_t threads = 1) -> void {
+    if (&other == this || empty()) return;
+    size_t size = size_;
+    auto [ kept, doomed ] = intersect_(detach_(root_()), other.root_(), threads);
+    size_t count = deleteChain_(doomed);
+    resetRoot_(kept.root, size - count);
+  }
+  /**
+   * Erases the values that have an equivalent in other, in
+   * the same time as intersect.
+   */
+  auto subtract (const RbTree &other, size_t threads = 1) -> void {
+    if (&other == this) {
+      clear();
+      return;
+    }
+    if (empty()) return;
+    size_t size = size_;
+    auto [ kept, doomed ] = subtract_(detach_(root_()), other.root_(), threads);
+    size_t count = deleteChain_(doomed);
+    resetRoot_(kept.root, size - count);
+  }
+  /**
+   * The k-th smallest element, counting from 0, or end()
+   * if there are no more than k elements. Requires kRanked.
+   */
+  auto nth (size_t k) -> iterator {
+    static_assert(kRanked, "nth() requires an order-statistics tree");
+    Node *node = root_();
+    while (node != nullptr) {
+      size_t leftCount = count_(node->left);
+      if (k == leftCount) return iterator(node, this);
+      if (k < leftCount) {
+        node = node->left;
+      } else {
+        k -= leftCount + 1;
+        node = node->right;
+      }
+    }
+    return end();
+  }
+  auto nth (size_t k) const -> const_iterator {
+    return const_cast<RbTree *>(this)->nth(k);
+  }
+  /// The number of elements less than key. Requires kRanked.
+  template <typename K>
+  auto rank (const K &key) const -> size_t {
+    static_assert(kRanked, "rank() requires an order-statistics tree");
+    Cmp cmp;
+    size_t result = 0;
+    const Node *node = root_();
+    while (node != nullptr) {
+      if (cmp(node->value(), key)) {
+        result += count_(node->left) + 1;
+        node = node->right;
+      } else {
+        node = node->left;
+      }
+    }
+    return result;
+  }
+  /**
+   * Checks the links, colors, order, subtree sizes and
+   * cached bounds of the tree in O(n), for tests.
+   */
+  auto valid () const -> bool {
+    if (endNode_ == nullptr) return true;
+    Node *root = endNode_->left;
+    if (root == nullptr) {
+      return leftmost_ == endNode_ && rightmost_ == endNode_ && size_ == 0;
+    }
+    if (root->parent() != endNode_ || root->type() != Node::kBlack) return false;
+    if (leftmost_ != root->min() || rightmost_ != root->max()) return false;
+    size_t count = 0;
+    if (validSubtree_(root, nullptr, nullptr, count) == 0) return false;
+    return size_ == count;
+  }
 
  private:
-  class Node {
+  /**
+   * A tree node. The color lives in the lowest bit of the
+   * parent pointer, which is always 0 as nodes are aligned,
+   * and the value is constructed and destructed by the tree
+   * in raw storage, so that a node of map<int, int> takes
+   * four words rather than five. The value of the end node
+   * is never constructed.
+   */
+  class Node : public SubtreeSize<kRanked> {
    public:
-    Node *parent = nullptr;
+    enum Type { kRed, kBlack };
     Node *left = nullptr;
     Node *right = nullptr;
-    enum Type { kRed, kBlack };
-    Type type;
-    Optional<ValueType> value;
     Node () = default;
-    Node (const ValueType &value) : value(value) {}
-    /// Destroys all the descendants, but not its parent.
-    auto destroy () noexcept -> void {
-      // should not destroy parent here.
-      if (left != nullptr) {
-        left->destroy();
-        delete left;
-        left = nullptr;
-      }
-      if (right != nullptr) {
-        right->destroy();
-        delete right;
-        right = nullptr;
-      }
+    auto parent () const -> Node * {
+      return reinterpret_cast<Node *>(parent_ & ~kColorMask_);
+    }
+    auto setParent (Node *parent) -> void {
+      parent_ = reinterpret_cast<std::uintptr_t>(parent) | (parent_ & kColorMask_);
+    }
+    auto type () const -> Type {
+      return static_cast<Type>(parent_ & kColorMask_);
+    }
+    auto setType (Type type) -> void {
+      parent_ = (parent_ & ~kColorMask_) | type;
+    }
+    auto value () -> ValueType & {
+      return *std::launder(reinterpret_cast<ValueType *>(value_));
+    }
+    auto value () const -> const ValueType & {
+      return *std::launder(reinterpret_cast<const ValueType *>(value_));
+    }
+    /// Where the tree constructs the value.
+    auto storage () -> void * {
+      return value_;
     }
     /// Is the node a left child?
     auto isLeft () -> bool {
-      return parent->left == this;
+      return parent()->left == this;
     }
     /// The neighbor aka sibling of the node.
     /// @nullable
     auto neighbor () -> Node * {
-      return isLeft() ? parent->right : parent->left;
+      return isLeft() ? parent()->right : parent()->left;
     }
     /// Unplugs the node from its parent, and plugs the replacement in.
     auto replace (Node *replacement) -> void {
-      (isLeft() ? parent->left : parent->right) = replacement;
-      if (replacement != nullptr) replacement->parent = parent;
-    }
-
-    /**
-     * Constructs and inserts the new node into the tree
-     * hierachy. It takes care of the order, but does not
-     * attempt to repair balance. Therefore, it is possible
-     * to get an invalid tree after calling.
-     *
-     * @returns nullopt if successful, Node * if a duplicate
-     *   is found, the duplicate node.
-     */
-    auto emplace (const value_type &v) -> Optional<Node *> {
-      Cmp cmp;
-      if (!cmp(v, value.force()) && !cmp(value.force(), v)) {
-        return this;
-      }
-      Node *&next = cmp(v, value.force()) ? left : right;
-      if (next != nullptr) {
-        return next->emplace(v);
-      }
-      Node *newNode = new Node(v);
-      newNode->parent = this;
-      next = newNode;
-      newNode->type = kRed;
-      Optional opt = newNode;
-      opt.has = false;
-      return opt;
+      (isLeft() ? parent()->left : parent()->right) = replacement;
+      if (replacement != nullptr) replacement->setParent(parent());
     }
 
     /// The minimal node of the tree.
     auto min () -> Node * {
-      return left == nullptr ? this : left->min();
+      Node *node = this;
+      while (node->left != nullptr) node = node->left;
+      return node;
     }
     /// The maximal node of the tree.
     auto max () -> Node * {
-      return right == nullptr ? this : right->max();
+      Node *node = this;
+      while (node->right != nullptr) node = node->right;
+      return node;
     }
     /// The node that immediately follows this node in ascending order.
     auto next () -> Node * {
       if (right != nullptr) return right->min();
       Node *node = this;
-      while (!node->isLeft()) node = node->parent;
-      return node->parent;
+      while (!node->isLeft()) node = node->parent();
+      return node->parent();
     }
     /// The node that immediately precedes this node in ascending order.
     auto prev () -> Node * {
       if (left != nullptr) return left->max();
       Node *node = this;
-      while (node->isLeft()) node = node->parent;
-      return node->parent;
-    }
-
-    /// Makes a clean clone of the tree hierachy.
-    auto clone (Node *parent) -> Node * {
-      Node *newNode = new Node(*this);
-      newNode->parent = parent;
-      if (left != nullptr) newNode->left = left->clone(newNode);
-      if (right != nullptr) newNode->right = right->clone(newNode);
-      return newNode;
+      while (node->isLeft()) node = node->parent();
+      return node->parent();
     }
 
     /**
@@ -390,19 +770,26 @@ class RbTree {
     template <typename K>
     auto find (const K &key) const -> Optional<const Node *> {
       Cmp cmp_;
-      if (!cmp_(key, value.force()) && !cmp_(value.force(), key)) {
-        return this;
-      }
-      if (cmp_(key, value.force())) {
-        if (left == nullptr) return nullopt();
-        return left->find(key);
+      const Node *node = this;
+      while (node != nullptr) {
+        if (cmp_(key, node->value())) {
+          node = node->left;
+        } else if (cmp_(node->value(), key)) {
+          node = node->right;
+        } else {
+          return node;
+        }
       }
-      if (right == nullptr) return nullopt();
-      return right->find(key);
+      return nullopt();
     }
    private:
+    static constexpr std::uintptr_t kColorMask_ = 1;
+    static_assert(alignof(Node *) > kColorMask_);
+    // the parent pointer, tagged with the color.
+    std::uintptr_t parent_ = kBlack;
+    alignas(ValueType) char value_[sizeof(ValueType)];
     auto lt_ (const Node *lhs, const Node *rhs) {
-      return Cmp()(lhs->value.force(), rhs->value.force());
+      return Cmp()(lhs->value(), rhs->value());
     }
   };
   /**
@@ -413,20 +800,152 @@ class RbTree {
   Node *endNode_ = nullptr;
   // for O(1) begin() and cbegin().
   Node *leftmost_ = nullptr;
+  // for O(1) appends.
+  Node *rightmost_ = nullptr;
   size_t size_ = 0;
+  // up to this many values, erasing them one by one beats
+  // splitting and joining, or rebuilding the tree.
+  static constexpr size_t kEraseCutoff_ = 32;
+  // subtrees of a lower black height, i.e. of fewer than
+  // about 2^kForkHeight_ values, are not worth a thread.
+  static constexpr size_t kForkHeight_ = 10;
+  NodePool<Node, Alloc> pool_;
+  /// Creates a node with the value constructed from args.
+  template <typename ...Args>
+  auto newNode_ (Args &&...args) -> Node * {
+    return newNodeIn_(pool_, std::forward<Args>(args)...);
+  }
+  /// Creates a node in the given pool.
+  template <typename ...Args>
+  static auto newNodeIn_ (NodePool<Node, Alloc> &pool, Args &&...args) -> Node * {
+    Node *node = new(pool.allocate()) Node;
+    try {
+      new(node->storage()) ValueType(std::forward<Args>(args)...);
+    } catch (...) {
+      pool.deallocate(node);
+      throw;
+    }
+    return node;
+  }
+  /// Creates the end node, which has no value.
+  auto newEndNode_ () -> Node * {
+    return new(pool_.allocate()) Node;
+  }
+  auto deleteNode_ (Node *node) noexcept -> void {
+    node->value().~ValueType();
+    pool_.deallocate(node);
+  }
   auto init_ () -> void {
-    leftmost_ = endNode_ = new Node();
+    leftmost_ = rightmost_ = endNode_ = newEndNode_();
     size_ = 0;
   }
+  /// Destructs all the values and frees all the nodes at once.
   auto destroy_ () noexcept -> void {
     if (endNode_ != nullptr) {
-      endNode_->destroy();
-      delete endNode_;
+      if constexpr (!std::is_trivially_destructible_v<ValueType>) {
+        if (root_() != nullptr) destroyValues_(root_());
+      }
+      pool_.release();
       endNode_ = nullptr;
-      leftmost_ = nullptr;
+      leftmost_ = rightmost_ = nullptr;
     }
     size_ = 0;
   }
+  /**
+   * Destructs the node together with all its descendants,
+   * without freeing them. It walks the subtree in post
+   * order along the parent pointers, unlinking every node
+   * it is done with, so it needs no stack.
+   */
+  static auto destroyValues_ (Node *root) noexcept -> void {
+    Node *node = root;
+    while (true) {
+      while (node->left != nullptr || node->right != nullptr) {
+        node = node->left != nullptr ? node->left : node->right;
+      }
+      Node *parent = node->parent();
+      node->value().~ValueType();
+      if (node == root) return;
+      (parent->left == node ? parent->left : parent->right) = nullptr;
+      node = parent;
+    }
+  }
+  /// Copies a single node into pool, leaving it unlinked.
+  static auto cloneNode_ (NodePool<Node, Alloc> &pool, const Node *node, Node *parent) -> Node * {
+    Node *newNode = newNodeIn_(pool, node->value());
+    newNode->setParent(parent);
+    newNode->setType(node->type());
+    if constexpr (kRanked) newNode->count = node->count;
+    return newNode;
+  }
+  /**
+   * Makes a clean clone of the tree hierachy. It walks the
+   * source in pre order along the parent pointers of both
+   * trees, so it needs no stack. On failure, the partial
+   * clone is destructed.
+   */
+  static auto clone_ (NodePool<Node, Alloc> &pool, const Node *root, Node *parent) -> Node * {
+    Node *newRoot = cloneNode_(pool, root, parent);
+    const Node *from = root;
+    Node *to = newRoot;
+    try {
+      while (true) {
+        if (from->left != nullptr && to->left == nullptr) {
+          to->left = cloneNode_(pool, from->left, to);
+          from = from->left;
+          to = to->left;
+        } else if (from->right != nullptr && to->right == nullptr) {
+          to->right = cloneNode_(pool, from->right, to);
+          from = from->right;
+          to = to->right;
+        } else if (from == root) {
+          return newRoot;
+        } else {
+          from = from->parent();
+          to = to->parent();
+        }
+      }
+    } catch (...) {
+      destroyValues_(newRoot);
+      throw;
+    }
+  }
+  /**
+   * Clones the subtree of the given black height like
+   * clone_, on up to threads threads: the left half of a
+   * large subtree is cloned on another thread into a pool
+   * of its own, which pool shares once it is done.
+   */
+  static auto cloneParallel_ (NodePool<Node, Alloc> &pool, const Node *root, Node *parent, size_t height, size_t threads) -> Node * {
+    if (threads <= 1 || height < kForkHeight_) return clone_(pool, root, parent);
+    size_t childHeight = height - (root->type() == Node::kBlack ? 1 : 0);
+    Node *newRoot = cloneNode_(pool, root, parent);
+    NodePool<Node, Alloc> leftPool(pool.get_allocator());
+    if constexpr (kRanked) {
+      if (root->left != nullptr) leftPool.reserve(root->left->count);
+    }
+    Node *left = nullptr;
+    Node *right = nullptr;
+    try {
+      forkJoin_(threads, height,
+        [&] (size_t n) {
+          if (root->left != nullptr) left = cloneParallel_(leftPool, root->left, newRoot, childHeight, n);
+        },
+        [&] (size_t n) {
+          if (root->right != nullptr) right = cloneParallel_(pool, root->right, newRoot, childHeight, n);
+        });
+      pool.share(leftPool);
+    } catch (...) {
+      if (left != nullptr) destroyValues_(left);
+      if (right != nullptr) destroyValues_(right);
+      newRoot->value().~ValueType();
+      pool.deallocate(newRoot);
+      throw;
+    }
+    newRoot->left = left;
+    newRoot->right = right;
+    return newRoot;
+  }
   struct TagPair {
     Node * Node::*left;
     Node * Node::*right;
@@ -450,79 +969,680 @@ class RbTree {
   /// Sets the root and performs fixups.
   auto setRoot_ (Node *root) -> void {
     endNode_->left = root;
-    root->parent = endNode_;
-    root->type = Node::kBlack;
+    root->setParent(endNode_);
+    root->setType(Node::kBlack);
+  }
+
+  /**
+   * Fills an empty tree with the values in [first, last).
+   * The nodes are created in input order, sorted and
+   * deduplicated only if needed, and then linked into a
+   * balanced tree by bisection.
+   */
+  template <typename InputIt>
+  auto build_ (InputIt first, InputIt last) -> void {
+    sjtu::vector<Node *> nodes;
+    try {
+      for (; first != last; ++first) {
+        nodes.push_back(nullptr);
+        nodes[nodes.size() - 1] = newNode_(*first);
+      }
+    } catch (...) {
+      for (Node *node : nodes) {
+        if (node != nullptr) deleteNode_(node);
+      }
+      throw;
+    }
+    auto lt = [] (const Node *lhs, const Node *rhs) {
+      return Cmp()(lhs->value(), rhs->value());
+    };
+    size_t n = nodes.size();
+    bool sorted = true;
+    for (size_t i = 1; i < n && sorted; ++i) sorted = lt(nodes[i - 1], nodes[i]);
+    if (!sorted) {
+      // stable, so that the first of equivalent values stays.
+      std::stable_sort(nodes.begin(), nodes.end(), lt);
+      size_t unique = 1;
+      for (size_t i = 1; i < n; ++i) {
+        if (lt(nodes[unique - 1], nodes[i])) {
+          nodes[unique++] = nodes[i];
+        } else {
+          deleteNode_(nodes[i]);
+        }
+      }
+      n = unique;
+    }
+    if (n == 0) return;
+    Node **next = &nodes[0];
+    relink_([&] { return *next++; }, n);
+  }
+  /**
+   * Makes the n sorted nodes, taken in order from next(),
+   * the whole tree, linked by link_.
+   */
+  template <typename Next>
+  auto relink_ (Next next, size_t n) -> void {
+    if (n == 0) {
+      resetRoot_(nullptr, 0);
+      return;
+    }
+    // the last level, if incomplete, is red.
+    size_t redDepth = 0;
+    while ((size_t(2) << redDepth) <= n + 1) ++redDepth;
+    setRoot_(link_(next, n, 0, redDepth));
+    leftmost_ = root_()->min();
+    rightmost_ = root_()->max();
+    size_ = n;
+  }
+  /**
+   * Links the next n sorted nodes from next() into a
+   * balanced subtree, taking them in order.
+   */
+  template <typename Next>
+  auto link_ (Next &next, size_t n, size_t depth, size_t redDepth) -> Node * {
+    if (n == 0) return nullptr;
+    size_t mid = (n - 1) / 2;
+    Node *left = link_(next, mid, depth + 1, redDepth);
+    Node *node = next();
+    node->left = left;
+    node->right = link_(next, n - mid - 1, depth + 1, redDepth);
+    if (node->left != nullptr) node->left->setParent(node);
+    if (node->right != nullptr) node->right->setParent(node);
+    node->setType(depth == redDepth ? Node::kRed : Node::kBlack);
+    if constexpr (kRanked) node->count = n;
+    return node;
+  }
+
+  /**
+   * Finds the first node whose value is not less than key,
+   * or greater than key if kUpper, in a single descent.
+   */
+  template <bool kUpper, typename K>
+  auto bound_ (const K &key) const -> Node * {
+    Cmp cmp;
+    Node *result = endNode_;
+    Node *node = endNode_->left;
+    while (node != nullptr) {
+      bool right = kUpper ? !cmp(key, node->value()) : cmp(node->value(), key);
+      if (right) {
+        node = node->right;
+      } else {
+        result = node;
+        node = node->left;
+      }
+    }
+    return result;
+  }
+
+  /// A subtree detached from any tree, with its black height.
+  struct Subtree {
+    Node *root;
+    size_t height;
+  };
+  /// The number of black nodes on any path down from node, inclusive.
+  static auto blackHeight_ (const Node *node) -> size_t {
+    size_t height = 0;
+    for (; node != nullptr; node = node->left) {
+      if (node->type() == Node::kBlack) ++height;
+    }
+    return height;
+  }
+  /**
+   * Checks the subtree under node, whose values must lie
+   * strictly between those of lo and hi where not null, and
+   * adds its size to count. Returns its black height, with
+   * the null leaves counted, or 0 if it is invalid.
+   */
+  static auto validSubtree_ (const Node *node, const Node *lo, const Node *hi, size_t &count) -> size_t {
+    if (node == nullptr) return 1;
+    Cmp cmp;
+    if (lo != nullptr && !cmp(lo->value(), node->value())) return 0;
+    if (hi != nullptr && !cmp(node->value(), hi->value())) return 0;
+    for (const Node *child : { node->left, node->right }) {
+      if (child == nullptr) continue;
+      if (child->parent() != node) return 0;
+      if (node->type() == Node::kRed && child->type() == Node::kRed) return 0;
+    }
+    size_t before = count;
+    size_t left = validSubtree_(node->left, lo, node, count);
+    size_t right = validSubtree_(node->right, node, hi, count);
+    if (left == 0 || left != right) return 0;
+    ++count;
+    if constexpr (kRanked) {
+      if (node->count != count - before) return 0;
+    }
+    return left + (node->type() == Node::kBlack ? 1 : 0);
+  }
+  /**
+   * Detaches the subtree from its parent, so that it forms
+   * a valid red-black tree on its own.
+   */
+  static auto detach_ (Node *root) -> Subtree {
+    if (root == nullptr) return { nullptr, 0 };
+    root->setParent(nullptr);
+    root->setType(Node::kBlack);
+    return { root, blackHeight_(root) };
+  }
+  /**
+   * Makes the detached subtree the whole tree. size is
+   * ignored for ranked trees, whose root knows better.
+   */
+  auto resetRoot_ (Node *root, size_t size) -> void {
+    endNode_->left = root;
+    size_ = 0;
+    leftmost_ = rightmost_ = endNode_;
+    if (root == nullptr) return;
+    root->setParent(endNode_);
+    leftmost_ = root->min();
+    rightmost_ = root->max();
+    if constexpr (kRanked) {
+      size_ = root->count;
+    } else {
+      size_ = size;
+    }
+  }
+  /**
+   * Joins two detached subtrees and the pivot, which lies
+   * between them in order, into one. The shorter tree is
+   * hung on the spine of the taller one facing it, at the
+   * same black height, with the pivot as a red root, and
+   * the usual insert fixups follow. O(1 + the difference
+   * in black heights).
+   */
+  auto join_ (Subtree left, Node *pivot, Subtree right) -> Subtree {
+    bool leftTaller = left.height >= right.height;
+    auto [ outer, inner ] = getTagPair_(leftTaller);
+    Subtree tall = leftTaller ? left : right;
+    Subtree low = leftTaller ? right : left;
+    // a stand-in for the end node while fixing up.
+    Node header;
+    header.left = tall.root;
+    if (tall.root != nullptr) tall.root->setParent(&header);
+    Node *parent = &header;
+    Node *node = tall.root;
+    size_t height = tall.height;
+    while (node != nullptr && (node->type() == Node::kRed || height > low.height)) {
+      if (node->type() == Node::kBlack) --height;
+      parent = node;
+      node = node->*inner;
+    }
+    (parent == &header ? header.left : parent->*inner) = pivot;
+    pivot->setParent(parent);
+    pivot->*outer = node;
+    pivot->*inner = low.root;
+    if (node != nullptr) node->setParent(pivot);
+    if (low.root != nullptr) low.root->setParent(pivot);
+    pivot->setType(Node::kRed);
+    if constexpr (kRanked) {
+      pivot->count = 1 + count_(node) + count_(low.root);
+      addCount_(parent, 1 + count_(low.root));
+    }
+    fixupInsert_(pivot);
+    Subtree joined = { header.left, tall.height };
+    joined.root->setParent(nullptr);
+    if (joined.root->type() == Node::kRed) {
+      joined.root->setType(Node::kBlack);
+      ++joined.height;
+    }
+    return joined;
+  }
+  /**
+   * Splits the detached subtree into the values less than
+   * key and the rest, by joining the pieces on the way
+   * down. The joins take O(log n) in total, as the black
+   * heights of the pieces increase on each side.
+   */
+  template <typename K>
+  auto split_ (Subtree tree, const K &key) -> sjtu::pair<Subtree, Subtree> {
+    Node *root = tree.root;
+    if (root == nullptr) return { tree, tree };
+    size_t height = tree.height - (root->type() == Node::kBlack ? 1 : 0);
+    Subtree left = detachChild_(root->left, height);
+    Subtree right = detachChild_(root->right, height);
+    if (Cmp()(root->value(), key)) {
+      auto [ less, rest ] = split_(right, key);
+      return { join_(left, root, less), rest };
+    }
+    auto [ less, rest ] = split_(left, key);
+    return { less, join_(rest, root, right) };
+  }
+  /**
+   * Erases the values from first up to, but excluding,
+   * last, which may be the end node: the tree is split
+   * before both, the middle freed, and the rest joined with
+   * last as the pivot.
+   */
+  auto eraseRange_ (Node *first, Node *last) -> void {
+    size_t size = size_;
+    Node *root = root_();
+    root->setParent(nullptr);
+    auto [ less, rest ] = split_({ root, blackHeight_(root) }, first->value());
+    Subtree doomed = rest;
+    Subtree more = { nullptr, 0 };
+    if (last != endNode_) {
+      auto [ middle, right ] = split_(rest, last->value());
+      doomed = middle;
+      more = right;
+    }
+    size -= deleteSubtree_(doomed.root);
+    if (last == endNode_) {
+      resetRoot_(less.root, size);
+      return;
+    }
+    // last is the least of more; take it out to be the pivot.
+    resetRoot_(more.root, 0);
+    delete_(last);
+    Subtree right = detach_(root_());
+    Subtree joined = join_(less, last, right);
+    resetRoot_(joined.root, size);
+  }
+  /**
+   * Destructs and frees the detached subtree, in post order
+   * as destroyValues_ does, and returns its size.
+   */
+  auto deleteSubtree_ (Node *root) noexcept -> size_t {
+    if (root == nullptr) return 0;
+    size_t count = 0;
+    Node *node = root;
+    while (true) {
+      while (node->left != nullptr || node->right != nullptr) {
+        node = node->left != nullptr ? node->left : node->right;
+      }
+      Node *parent = node->parent();
+      bool isRoot = node == root;
+      if (!isRoot) (parent->left == node ? parent->left : parent->right) = nullptr;
+      deleteNode_(node);
+      ++count;
+      if (isRoot) return count;
+      node = parent;
+    }
+  }
+  /**
+   * Detached subtrees strung together through their parent
+   * pointers, in order; a value is the same as a one-node
+   * subtree.
+   */
+  struct Chain {
+    Node *head = nullptr;
+    Node *tail = nullptr;
+    size_t size = 0;
+    auto push (Node *root) -> void {
+      root->setParent(nullptr);
+      if (tail == nullptr) {
+        head = root;
+      } else {
+        tail->setParent(root);
+      }
+      tail = root;
+      ++size;
+    }
+    auto append (const Chain &other) -> void {
+      if (other.head == nullptr) return;
+      if (tail == nullptr) {
+        *this = other;
+        return;
+      }
+      tail->setParent(other.head);
+      tail = other.tail;
+      size += other.size;
+    }
+  };
+  /// A detached subtree, and a chain of nodes left over.
+  struct Pieces {
+    Subtree tree;
+    Chain rest;
+  };
+  /// The three parts of a split around a key.
+  struct Split {
+    Subtree less;
+    Node *equal;
+    Subtree greater;
+  };
+  /**
+   * Splits the detached subtree into the values less than
+   * key, the one equivalent to key if any, which is left
+   * unlinked, and the values greater than key.
+   */
+  template <typename K>
+  auto splitAround_ (Subtree tree, const K &key) -> Split {
+    Node *root = tree.root;
+    if (root == nullptr) return { tree, nullptr, tree };
+    size_t height = tree.height - (root->type() == Node::kBlack ? 1 : 0);
+    Subtree left = detachChild_(root->left, height);
+    Subtree right = detachChild_(root->right, height);
+    if (Cmp()(root->value(), key)) {
+      Split split = splitAround_(right, key);
+      split.less = join_(left, root, split.less);
+      return split;
+    }
+    if (Cmp()(key, root->value())) {
+      Split split = splitAround_(left, key);
+      split.greater = join_(split.greater, root, right);
+      return split;
+    }
+    root->left = root->right = nullptr;
+    return { left, root, right };
+  }
+  /// Takes the least value out of a non-empty detached subtree.
+  auto popMin_ (Subtree tree) -> sjtu::pair<Subtree, Node *> {
+    Node *root = tree.root;
+    size_t height = tree.height - (root->type() == Node::kBlack ? 1 : 0);
+    Subtree left = detachChild_(root->left, height);
+    Subtree right = detachChild_(root->right, height);
+    if (left.root == nullptr) {
+      root->right = nullptr;
+      return { right, root };
+    }
+    auto [ rest, min ] = popMin_(left);
+    return { join_(rest, root, right), min };
+  }
+  /// Joins two detached subtrees, the left all less than the right, without a pivot.
+  auto join2_ (Subtree left, Subtree right) -> Subtree {
+    if (left.root == nullptr) return right;
+    if (right.root == nullptr) return left;
+    auto [ rest, pivot ] = popMin_(right);
+    return join_(left, pivot, rest);
+  }
+  /**
+   * Runs left and right, which take the number of threads
+   * they may use, on up to threads threads: left on a new
+   * one, unless there is a single thread, the subtree of
+   * the given black height is too small to be worth it, or
+   * no thread can be started.
+   */
+  template <typename Left, typename Right>
+  static auto forkJoin_ (size_t threads, size_t height, Left &&left, Right &&right) -> void {
+    if (threads <= 1 || height < kForkHeight_) {
+      left(1);
+      right(1);
+      return;
+    }
+    size_t half = threads / 2;
+    std::future<void> future;
+    try {
+      future = std::async(std::launch::async, [&] { left(half); });
+    } catch (...) {
+      left(1);
+      right(threads);
+      return;
+    }
+    try {
+      right(threads - half);
+    } catch (...) {
+      future.wait();
+      throw;
+    }
+    future.get();
+  }
+  /**
+   * The union of two detached subtrees, taking the values
+   * of mine over equivalent ones of theirs, which are
+   * returned in order.
+   */
+  auto union_ (Subtree mine, Subtree theirs, size_t threads) -> Pieces {
+    if (theirs.root == nullptr || mine.root == nullptr) {
+      return { mine.root == nullptr ? theirs : mine, Chain() };
+    }
+    Node *root = mine.root;
+    size_t height = mine.height - (root->type() == Node::kBlack ? 1 : 0);
+    Subtree left = detachChild_(root->left, height);
+    Subtree right = detachChild_(root->right, height);
+    Split split = splitAround_(theirs, root->value());
+    Pieces less, greater;
+    forkJoin_(threads, mine.height,
+      [&] (size_t n) { less = union_(left, split.less, n); },
+      [&] (size_t n) { greater = union_(right, split.greater, n); });
+    Chain duplicates = less.rest;
+    if (split.equal != nullptr) duplicates.push(split.equal);
+    duplicates.append(greater.rest);
+    return { join_(less.tree, root, greater.tree), duplicates };
+  }
+  /**
+   * The values of the detached subtree mine with an
+   * equivalent under theirs, and the subtrees of the others.
+   */
+  auto intersect_ (Subtree mine, const Node *theirs, size_t threads) -> Pieces {
+    Chain doomed;
+    if (mine.root == nullptr) return { mine, doomed };
+    if (theirs == nullptr) {
+      doomed.push(mine.root);
+      return { Subtree { nullptr, 0 }, doomed };
+    }
+    Split split = splitAround_(mine, theirs->value());
+    Pieces less, greater;
+    forkJoin_(threads, mine.height,
+      [&] (size_t n) { less = intersect_(split.less, theirs->left, n); },
+      [&] (size_t n) { greater = intersect_(split.greater, theirs->right, n); });
+    doomed = less.rest;
+    doomed.append(greater.rest);
+    if (split.equal == nullptr) return { join2_(less.tree, greater.tree), doomed };
+    return { join_(less.tree, split.equal, greater.tree), doomed };
+  }
+  /**
+   * The values of the detached subtree mine without an
+   * equivalent under theirs, and the others.
+   */
+  auto subtract_ (Subtree mine, const Node *theirs, size_t threads) -> Pieces {
+    if (mine.root == nullptr || theirs == nullptr) return { mine, Chain() };
+    Split split = splitAround_(mine, theirs->value());
+    Pieces less, greater;
+    forkJoin_(threads, mine.height,
+      [&] (size_t n) { less = subtract_(split.less, theirs->left, n); },
+      [&] (size_t n) { greater = subtract_(split.greater, theirs->right, n); });
+    Chain doomed = less.rest;
+    if (split.equal != nullptr) doomed.push(split.equal);
+    doomed.append(greater.rest);
+    return { join2_(less.tree, greater.tree), doomed };
+  }
+  /// Frees the subtrees in the chain, and returns their total size.
+  auto deleteChain_ (Chain chain) noexcept -> size_t {
+    size_t count = 0;
+    for (Node *root = chain.head; root != nullptr;) {
+      Node *next = root == chain.tail ? nullptr : root->parent();
+      root->setParent(nullptr);
+      count += deleteSubtree_(root);
+      root = next;
+    }
+    return count;
+  }
+  /// Detaches a child whose black height is known.
+  static auto detachChild_ (Node *child, size_t height) -> Subtree {
+    if (child == nullptr) return { nullptr, 0 };
+    child->setParent(nullptr);
+    if (child->type() == Node::kRed) {
+      child->setType(Node::kBlack);
+      ++height;
+    }
+    return { child, height };
+  }
+
+  /// The size of the subtree, for ranked trees.
+  static auto count_ (const Node *node) -> size_t {
+    return node == nullptr ? 0 : node->count;
+  }
+  /// Recounts the subtree size from the children's.
+  static auto pull_ (Node *node) -> void {
+    if constexpr (kRanked) node->count = 1 + count_(node->left) + count_(node->right);
+  }
+  /// Adds delta to the subtree sizes of node and all its ancestors.
+  static auto addCount_ (Node *node, size_t delta) -> void {
+    if constexpr (kRanked) {
+      // stops at the end node, or any stand-in for it.
+      for (; node->parent() != nullptr; node = node->parent()) node->count += delta;
+    }
   }
 
   auto rotate_ (Node *x, TagPair direction) -> void {
     auto [ left, right ] = direction;
     Node *y = x->*right;
     x->*right = y->*left;
-    if (y->*left != nullptr) (y->*left)->parent = x;
+    if (y->*left != nullptr) (y->*left)->setParent(x);
     x->replace(y);
     y->*left = x;
-    x->parent = y;
+    x->setParent(y);
+    pull_(x);
+    pull_(y);
   }
 
+  /// An empty child slot in the tree, where a new node goes.
+  struct Slot {
+    Node *parent;
+    bool isLeft;
+  };
   /**
-   * Constructs and inserts a new node and performs fixups
-   * if necessary. It updates leftmost_ but not size_.
+   * Constructs a new node from args if no node is equivalent
+   * to key, inserts it and performs fixups if necessary. It
+   * updates leftmost_ and rightmost_ but not size_.
+   * Appending to the end takes no search.
    *
    * @returns nullopt if successful, Node * if a duplicate
    *   is found, the duplicate node.
    */
-  auto emplace_ (const value_type &value) -> Optional<Node *> {
-    if (root_() == nullptr) {
-      Node *newNode = new Node(value);
-      setRoot_(newNode);
-      leftmost_ = newNode;
-      Optional opt = newNode;
-      opt.has = false;
-      return opt;
-    }
-    auto dup = root_()->emplace(value);
-    if (dup.has) return dup;
-    Node *newNode = dup.force();
-    newNode->type = newNode == root_() ? Node::kBlack : Node::kRed;
-    // trick copied from libc++: if the left child of the
-    // old leftmost node is not nullptr, then it must be
-    // the new node.
-    if (leftmost_->left != nullptr) leftmost_ = newNode;
-    fixupInsert_(newNode);
-    root_()->type = Node::kBlack;
-    return dup;
-  }
-  /// Performs fixups after an insert.
+  template <typename K, typename ...Args>
+  auto emplace_ (const K &key, Args &&...args) -> Optional<Node *> {
+    Slot slot { endNode_, true };
+    if (root_() != nullptr) {
+      if (Cmp()(rightmost_->value(), key)) {
+        slot = { rightmost_, false };
+      } else {
+        Node *dup = findSlot_(key, slot);
+        if (dup != nullptr) return dup;
+      }
+    }
+    Optional<Node *> opt = attach_(slot, std::forward<Args>(args)...);
+    opt.has = false;
+    return opt;
+  }
+  /**
+   * Like emplace_, but searches around hint first. It
+   * takes amortized O(1) if value goes right before or
+   * right after hint.
+   */
+  auto emplaceNear_ (Node *hint, const value_type &value) -> Optional<Node *> {
+    Slot slot { endNode_, true };
+    if (root_() != nullptr) {
+      Node *dup = findSlotNear_(hint, value, slot);
+      if (dup != nullptr) return dup;
+    }
+    Optional<Node *> opt = attach_(slot, value);
+    opt.has = false;
+    return opt;
+  }
+  /**
+   * Finds the slot for v by descending from the root.
+   *
+   * @returns the node equivalent to v if there is one, or
+   *   nullptr, with slot set.
+   */
+  template <typename K>
+  auto findSlot_ (const K &v, Slot &slot) -> Node * {
+    Cmp cmp;
+    Node *parent = root_();
+    bool less;
+    while (true) {
+      less = cmp(v, parent->value());
+      if (!less && !cmp(parent->value(), v)) return parent;
+      Node *next = less ? parent->left : parent->right;
+      if (next == nullptr) break;
+      parent = next;
+    }
+    slot = { parent, less };
+    return nullptr;
+  }
+  /**
+   * Finds the slot for v in a non-empty tree, checking the
+   * neighbors of hint before falling back to findSlot_.
+   * The slot between two adjacent nodes is always either
+   * the left of the latter or the right of the former.
+   */
+  auto findSlotNear_ (Node *hint, const value_type &v, Slot &slot) -> Node * {
+    Cmp cmp;
+    if (hint == endNode_ || cmp(v, hint->value())) {
+      if (hint == leftmost_) {
+        slot = { hint, true };
+        return nullptr;
+      }
+      Node *prev = hint == endNode_ ? rightmost_ : hint->prev();
+      if (cmp(prev->value(), v)) {
+        slot = hint != endNode_ && hint->left == nullptr
+          ? Slot { hint, true }
+          : Slot { prev, false };
+        return nullptr;
+      }
+      if (!cmp(v, prev->value())) return prev;
+      return findSlot_(v, slot);
+    }
+    if (cmp(hint->value(), v)) {
+      Node *next = hint->next();
+      if (next == endNode_ || cmp(v, next->value())) {
+        slot = hint->right == nullptr ? Slot { hint, false } : Slot { next, true };
+        return nullptr;
+      }
+      if (!cmp(next->value(), v)) return next;
+      return findSlot_(v, slot);
+    }
+    return hint;
+  }
+  /// Constructs a node from args into the slot, and rebalances.
+  template <typename ...Args>
+  auto attach_ (Slot slot, Args &&...args) -> Node * {
+    Node *node = newNode_(std::forward<Args>(args)...);
+    attachNode_(slot, node);
+    return node;
+  }
+  /// Links the new node into the slot, and rebalances.
+  auto attachNode_ (Slot slot, Node *node) -> void {
+    auto [ parent, isLeft ] = slot;
+    node->setParent(parent);
+    (isLeft ? parent->left : parent->right) = node;
+    node->setType(Node::kRed);
+    addCount_(parent, 1);
+    if (parent == endNode_) {
+      leftmost_ = rightmost_ = node;
+    } else if (parent == leftmost_ && isLeft) {
+      leftmost_ = node;
+    } else if (parent == rightmost_ && !isLeft) {
+      rightmost_ = node;
+    }
+    fixupInsert_(node);
+    root_()->setType(Node::kBlack);
+  }
+  /**
+   * Performs fixups after an insert. It may leave the root
+   * red, which the caller must paint black. The end node is
+   * black, so it stops there.
+   */
   auto fixupInsert_ (Node *node) -> void {
-    if (node->parent->type != Node::kRed) return;
-    if (node == root_()) return;
-    bool parentIsLeft = node->parent->isLeft();
+    if (node->parent()->type() != Node::kRed) return;
+    bool parentIsLeft = node->parent()->isLeft();
     TagPair dir = getTagPair_(parentIsLeft);
     auto [ left, right ] = dir;
-    Node *grandParent = node->parent->parent;
+    Node *grandParent = node->parent()->parent();
     Node *uncle = grandParent->*right;
-    if (uncle != nullptr && uncle->type == Node::kRed) {
-      node->parent->type = Node::kBlack;
-      grandParent->type = grandParent == root_() ? Node::kBlack : Node::kRed;
-      uncle->type = Node::kBlack;
+    if (uncle != nullptr && uncle->type() == Node::kRed) {
+      node->parent()->setType(Node::kBlack);
+      grandParent->setType(Node::kRed);
+      uncle->setType(Node::kBlack);
       // we have a bad uncle here, calling grandparent for help.
-      return fixupInsert_(node->parent->parent);
+      return fixupInsert_(node->parent()->parent());
     }
     if (parentIsLeft != node->isLeft()) {
-      node = node->parent;
+      node = node->parent();
       rotate_(node, dir);
     }
-    node->parent->type = Node::kBlack;
-    grandParent->type = Node::kRed;
+    node->parent()->setType(Node::kBlack);
+    grandParent->setType(Node::kRed);
     rotate_(grandParent, dir.inverse());
   }
 
   /**
    * Deletes the node and performs fixups if necessary.
    * It does not destruct the node, so the caller needs to
-   * do so by itself. It updates leftmost_ but not size_.
+   * do so by itself. It updates leftmost_ and rightmost_
+   * but not size_.
    */
   auto delete_ (Node *node) -> void {
+    if (node == rightmost_) rightmost_ = node == leftmost_ ? endNode_ : node->prev();
     if (node == leftmost_) leftmost_ = node->next();
     // y is the node to be removed, and would have at most one child.
     bool notFull = node->left == nullptr || node->right == nullptr;
@@ -533,40 +1653,43 @@ class RbTree {
     // will become childY's neighbor
     // @nullable
     Node *neighborY = y == root_() ? nullptr : y->neighbor();
+    // every ancestor of y's old position loses a node.
+    addCount_(y->parent(), -1);
     y->replace(childY);
-    bool shouldFixup = y->type == Node::kBlack && root_() != nullptr;
+    bool shouldFixup = y->type() == Node::kBlack && root_() != nullptr;
     if (node != y) {
       node->replace(y);
       y->left = node->left;
-      y->left->parent = y;
+      y->left->setParent(y);
       y->right = node->right;
-      if (y->right != nullptr) y->right->parent = y;
-      y->type = node->type;
+      if (y->right != nullptr) y->right->setParent(y);
+      y->setType(node->type());
+      if constexpr (kRanked) y->count = node->count;
     }
     if (shouldFixup) {
-      if (childY != nullptr) childY->type = Node::kBlack;
+      if (childY != nullptr) childY->setType(Node::kBlack);
       else fixupDelete_(neighborY);
     }
   }
   /// Performs fixups after a delete operation.
   auto fixupDelete_ (Node *neighbor) -> void {
     auto nullOrBlack = [] (Node *node) -> bool {
-      return node == nullptr || node->type == Node::kBlack;
+      return node == nullptr || node->type() == Node::kBlack;
     };
     // node is left child, so neighbor is right
     TagPair dir = getTagPair_(!neighbor->isLeft());
     auto [ left, right ] = dir;
-    if (neighbor->type == Node::kRed) {
-      neighbor->type = Node::kBlack;
-      neighbor->parent->type = Node::kRed;
-      rotate_(neighbor->parent, dir);
+    if (neighbor->type() == Node::kRed) {
+      neighbor->setType(Node::kBlack);
+      neighbor->parent()->setType(Node::kRed);
+      rotate_(neighbor->parent(), dir);
       neighbor = neighbor->*left->*right;
     }
     if (nullOrBlack(neighbor->left) && nullOrBlack(neighbor->right)) {
-      neighbor->type = Node::kRed;
-      Node *parent = neighbor->parent;
-      if (parent == root_() || parent->type == Node::kRed) {
-        parent->type = Node::kBlack;
+      neighbor->setType(Node::kRed);
+      Node *parent = neighbor->parent();
+      if (parent == root_() || parent->type() == Node::kRed) {
+        parent->setType(Node::kBlack);
         return;
       }
       // We have doubly black children and a bad parent.
@@ -575,18 +1698,26 @@ class RbTree {
     }
     // neighbor must have at least one red child at this point.
     if (nullOrBlack(neighbor->*right)) {
-      (neighbor->*left)->type = Node::kBlack;
-      neighbor->type = Node::kRed;
+      (neighbor->*left)->setType(Node::kBlack);
+      neighbor->setType(Node::kRed);
       rotate_(neighbor, dir.inverse());
-      neighbor = neighbor->parent;
+      neighbor = neighbor->parent();
     }
-    neighbor->type = neighbor->parent->type;
-    neighbor->parent->type = Node::kBlack;
-    (neighbor->*right)->type = Node::kBlack;
-    rotate_(neighbor->parent, dir);
+    neighbor->setType(neighbor->parent()->type());
+    neighbor->parent()->setType(Node::kBlack);
+    (neighbor->*right)->setType(Node::kBlack);
+    rotate_(neighbor->parent(), dir);
   }
 };
 
+/// Selects RbTree as the engine of sjtu::map.
+template <bool kRanked = false>
+class RbTreeEngine {
+ public:
+  template <typename ValueType, typename Cmp, typename Alloc>
+  using type = RbTree<ValueType, Cmp, Alloc, kRanked>;
+};
+
 } // namespace panic
 
 #endif // SJTU_TREE_HPP_
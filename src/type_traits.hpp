@@ -1,6 +1,11 @@
 #ifndef SJTU_TYPE_TRAITS_HPP_
 #define SJTU_TYPE_TRAITS_HPP_
 
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
 namespace sjtu {
 
 template <typename T, T v>
@@ -90,6 +95,44 @@ auto move (T &value) -> T && {
   return reinterpret_cast<T &&>(value);
 }
 
+/**
+ * Whether an object of T could be moved to another address
+ * by copying its bytes, without running its constructors or
+ * destructor. Trivially copyable types always are; types
+ * like unique handles, which merely own a pointer, could
+ * specialize this to opt in.
+ */
+template <typename T>
+class is_trivially_relocatable : public integral_constant<
+  bool,
+  std::is_trivially_copyable_v<T>
+> {};
+template <typename T>
+constexpr bool is_trivially_relocatable_v = is_trivially_relocatable<T>::value;
+
+/**
+ * Relocates n objects from `from` to `to`. Afterwards the
+ * objects live in `to`, and `from` is left as raw memory.
+ * The two ranges may overlap.
+ */
+template <typename T>
+auto relocate (T *to, T *from, size_t n) -> void {
+  if (to == from || n == 0) return;
+  if constexpr (is_trivially_relocatable_v<T>) {
+    std::memmove(static_cast<void *>(to), static_cast<const void *>(from), n * sizeof(T));
+  } else if (to < from) {
+    for (size_t i = 0; i < n; ++i) {
+      new(to + i) T(sjtu::move(from[i]));
+      from[i].~T();
+    }
+  } else {
+    for (size_t i = n; i > 0; --i) {
+      new(to + i - 1) T(sjtu::move(from[i - 1]));
+      from[i - 1].~T();
+    }
+  }
+}
+
 } // namespace sjtu
 
 #endif // SJTU_TYPE_TRAITS_HPP_
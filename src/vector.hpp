@@ -2,17 +2,122 @@
 #define SJTU_VECTOR_HPP
 
 #include "exceptions.hpp"
+#include "memory.hpp"
+#include "type_traits.hpp"
 
+#include <algorithm>
 #include <climits>
 #include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace sjtu {
+
+namespace internal {
+
+/**
+ * The inline buffer of small vectors: room for kN elements
+ * inside the vector object itself. Empty when kN is 0, so
+ * that plain vectors pay nothing for it.
+ */
+template <typename T, size_t kN>
+class InlineStorage {
+ protected:
+  auto inlineData_ () -> T * { return reinterpret_cast<T *>(inline_); }
+ private:
+  alignas(T) unsigned char inline_[kN * sizeof(T)];
+};
+template <typename T>
+class InlineStorage<T, 0> {
+ protected:
+  auto inlineData_ () -> T * { return nullptr; }
+};
+
+} // namespace internal
+
+/**
+ * Element access policies of vector, its last template
+ * parameter. checked_access throws on bad indices as the
+ * assignment requires, while unchecked_access trusts the
+ * caller, so that loops over operator[] have no branches
+ * left and may be vectorized. at() is always checked
+ * regardless of the policy.
+ *
+ * The policy is part of the type, so checked and unchecked
+ * vectors may live side by side in a program. Defining
+ * SJTU_UNCHECKED_ACCESS changes the default to unchecked;
+ * it must then be defined alike in every translation unit.
+ */
+class checked_access {
+ public:
+  static constexpr bool kChecked = true;
+};
+class unchecked_access {
+ public:
+  static constexpr bool kChecked = false;
+};
+#ifdef SJTU_UNCHECKED_ACCESS
+using default_access = unchecked_access;
+#else
+using default_access = checked_access;
+#endif
+
+/**
+ * Growth policies of vector. When a vector runs out of room,
+ * it asks its policy for the new capacity via
+ *   next(capacity, needed, sizeof(T)),
+ * which must return a capacity no less than needed.
+ */
+/// Multiplies the capacity by kNum / kDen, starting from 4.
+template <size_t kNum, size_t kDen>
+class factor_growth {
+ public:
+  static auto next (size_t capacity, size_t needed, size_t /* szT */) -> size_t {
+    size_t grown = capacity * kNum / kDen;
+    if (grown < kSzDefault_) grown = kSzDefault_;
+    return grown < needed ? needed : grown;
+  }
+ private:
+  static_assert(kNum > kDen, "the growth factor must be greater than 1");
+  static constexpr size_t kSzDefault_ = 4;
+};
+using doubling_growth = factor_growth<2, 1>;
+using golden_growth = factor_growth<3, 2>;
+/**
+ * Doubles the capacity, then rounds the buffer up to whole
+ * pages, so that no slack is wasted at the end of the last
+ * page once the buffer is large enough to be mmap'ed.
+ */
+template <size_t kPage = 4096>
+class page_growth {
+ public:
+  static auto next (size_t capacity, size_t needed, size_t szT) -> size_t {
+    size_t grown = doubling_growth::next(capacity, needed, szT);
+    if (grown * szT < kPage) return grown;
+    size_t bytes = (grown * szT + kPage - 1) / kPage * kPage;
+    return bytes / szT;
+  }
+};
+
 /**
  * a data container like std::vector
  * store data in a successive memory and support random access.
+ *
+ * The buffer comes from Allocator. The first kInline elements
+ * are kept inside the object, and the allocator is only
+ * asked once they are outgrown; see small_vector.hpp.
+ * Access selects whether operator[] checks its index.
  */
-template<typename T>
-class vector {
+template <
+  typename T,
+  typename Growth = doubling_growth,
+  typename Allocator = allocator<T>,
+  size_t kInline = 0,
+  typename Access = default_access
+> class vector : private internal::InlineStorage<T, kInline> {
  public:
   /**
    * you can see RandomAccessIterator at CppReference for help.
@@ -35,39 +140,58 @@ class vector {
     using value_type = T;
     using pointer = T *;
     using reference = T &;
-    using iterator_category = std::output_iterator_tag;
+    using iterator_category = std::random_access_iterator_tag;
+#ifdef __cpp_lib_ranges
+    using iterator_concept = std::contiguous_iterator_tag;
+#endif
 
    private:
-    vector *home_;
-    pointer ptr_;
+    vector *home_ = nullptr;
+    pointer ptr_ = nullptr;
     iterator (vector *home, pointer ptr) : home_(home), ptr_(ptr) {}
    public:
+    iterator () = default;
     /**
      * return a new iterator which pointer n-next elements
      * as well as operator-
      */
-    auto operator+ (const int &n) const -> iterator {
+    auto operator+ (difference_type n) const -> iterator {
       return iterator(home_, ptr_ + n);
     }
-    auto operator- (const int &n) const -> iterator {
+    friend auto operator+ (difference_type n, const iterator &it) -> iterator {
+      return it + n;
+    }
+    auto operator- (difference_type n) const -> iterator {
       return iterator(home_, ptr_ - n);
     }
     // return the distance between two iterators,
     // if these two iterators point to different vectors, throw invaild_iterator.
-    auto operator- (const iterator &rhs) const -> int {
-      if (home_ != rhs.home_) throw invalid_iterator();
-      return ptr_ = rhs.ptr_;
+    auto operator- (const iterator &rhs) const -> difference_type {
+      if constexpr (Access_::kChecked) {
+        if (home_ != rhs.home_) throw invalid_iterator();
+      }
+      return ptr_ - rhs.ptr_;
     }
-    auto operator+= (const int &n) -> iterator & {
+    auto operator+= (difference_type n) -> iterator & {
       ptr_ += n;
       return *this;
     }
-    auto operator-= (const int &n) -> iterator & { return (*this += -n); }
-    auto operator++ (int) const -> iterator { return operator+(1); }
+    auto operator-= (difference_type n) -> iterator & { return (*this += -n); }
+    auto operator++ (int) -> iterator {
+      iterator retval = *this;
+      ++ptr_;
+      return retval;
+    }
     auto operator++ () -> iterator & { return (*this += 1); }
-    auto operator-- (int) const -> iterator { return operator+(-1); }
+    auto operator-- (int) -> iterator {
+      iterator retval = *this;
+      --ptr_;
+      return retval;
+    }
     auto operator-- () -> iterator & { return (*this -= 1); }
     auto operator* () const -> T & { return *ptr_; }
+    auto operator-> () const noexcept -> T * { return ptr_; }
+    auto operator[] (difference_type n) const -> T & { return ptr_[n]; }
     /**
      * a operator to check whether two iterators are same (pointing to the same memory address).
      */
@@ -78,6 +202,10 @@ class vector {
      */
     auto operator!= (const iterator &rhs) const -> bool { return !(*this == rhs); }
     auto operator!= (const const_iterator &rhs) const -> bool { return !(*this == rhs); }
+    auto operator< (const const_iterator &rhs) const -> bool { return ptr_ < rhs.ptr_; }
+    auto operator> (const const_iterator &rhs) const -> bool { return ptr_ > rhs.ptr_; }
+    auto operator<= (const const_iterator &rhs) const -> bool { return ptr_ <= rhs.ptr_; }
+    auto operator>= (const const_iterator &rhs) const -> bool { return ptr_ >= rhs.ptr_; }
     friend class const_iterator;
     friend class vector;
   };
@@ -85,39 +213,59 @@ class vector {
    public:
     using difference_type = std::ptrdiff_t;
     using value_type = T;
-    using pointer = T *;
-    using reference = T &;
-    using iterator_category = std::output_iterator_tag;
+    using pointer = const T *;
+    using reference = const T &;
+    using iterator_category = std::random_access_iterator_tag;
+#ifdef __cpp_lib_ranges
+    using iterator_concept = std::contiguous_iterator_tag;
+#endif
 
    private:
-    const vector *home_;
-    const T *ptr_;
+    const vector *home_ = nullptr;
+    pointer ptr_ = nullptr;
     const_iterator (const vector *home, pointer ptr) : home_(home), ptr_(ptr) {}
    public:
+    const_iterator () = default;
+    const_iterator (const iterator &it) : home_(it.home_), ptr_(it.ptr_) {}
     /**
      * return a new iterator which pointer n-next elements
      * as well as operator-
      */
-    auto operator+ (const int &n) const -> const_iterator {
+    auto operator+ (difference_type n) const -> const_iterator {
       return const_iterator(home_, ptr_ + n);
     }
-    auto operator- (const int &n) const -> const_iterator {
+    friend auto operator+ (difference_type n, const const_iterator &it) -> const_iterator {
+      return it + n;
+    }
+    auto operator- (difference_type n) const -> const_iterator {
       return const_iterator(home_, ptr_ - n);
     }
-    auto operator- (const const_iterator &rhs) const -> int {
-      if (home_ != rhs.home_) throw invalid_iterator();
-      return ptr_ = rhs.ptr_;
+    auto operator- (const const_iterator &rhs) const -> difference_type {
+      if constexpr (Access_::kChecked) {
+        if (home_ != rhs.home_) throw invalid_iterator();
+      }
+      return ptr_ - rhs.ptr_;
     }
-    auto operator+= (const int &n) -> const_iterator & {
+    auto operator+= (difference_type n) -> const_iterator & {
       ptr_ += n;
       return *this;
     }
-    auto operator-= (const int &n) -> const_iterator & { return (*this += -n); }
-    auto operator++ (int) const -> const_iterator { return operator+(1); }
+    auto operator-= (difference_type n) -> const_iterator & { return (*this += -n); }
+    auto operator++ (int) -> const_iterator {
+      const_iterator retval = *this;
+      ++ptr_;
+      return retval;
+    }
     auto operator++ () -> const_iterator & { return (*this += 1); }
-    auto operator-- (int) const -> const_iterator { return operator+(-1); }
+    auto operator-- (int) -> const_iterator {
+      const_iterator retval = *this;
+      --ptr_;
+      return retval;
+    }
     auto operator-- () -> const_iterator & { return (*this -= 1); }
     auto operator* () const -> const T & { return *ptr_; }
+    auto operator-> () const noexcept -> const T * { return ptr_; }
+    auto operator[] (difference_type n) const -> const T & { return ptr_[n]; }
     /**
      * a operator to check whether two iterators are same (pointing to the same memory address).
      */
@@ -128,6 +276,10 @@ class vector {
      */
     auto operator!= (const iterator &rhs) const -> bool { return !(*this == rhs); }
     auto operator!= (const const_iterator &rhs) const -> bool { return !(*this == rhs); }
+    auto operator< (const const_iterator &rhs) const -> bool { return ptr_ < rhs.ptr_; }
+    auto operator> (const const_iterator &rhs) const -> bool { return ptr_ > rhs.ptr_; }
+    auto operator<= (const const_iterator &rhs) const -> bool { return ptr_ <= rhs.ptr_; }
+    auto operator>= (const const_iterator &rhs) const -> bool { return ptr_ >= rhs.ptr_; }
     friend class iterator;
     friend class vector;
   };
@@ -136,13 +288,18 @@ class vector {
    * Atleast two: default constructor, copy constructor
    */
   vector () = default;
-  vector (const vector &other) { *this = other; }
+  explicit vector (const Allocator &alloc) : alloc_(alloc) {}
+  vector (const vector &other)
+    : alloc_(Traits_::select_on_container_copy_construction(other.alloc_)) {
+    *this = other;
+  }
+  vector (vector &&other) noexcept : alloc_(sjtu::move(other.alloc_)) { steal_(other); }
   /**
    * TODO Destructor
    */
   ~vector () {
     destroyContents_();
-    delete[] reinterpret_cast<char *>(storage_);
+    release_();
   }
   /**
    * TODO Assignment operator
@@ -150,11 +307,41 @@ class vector {
   auto operator= (const vector &other) -> vector & {
     if (this == &other) return *this;
     clear();
-    grow_(other.capacity_);
+    grow_(other.size_);
     size_ = other.size_;
     copyContents_(storage_, other.storage_, size_);
     return *this;
   }
+  /**
+   * Takes over the buffer of other, along with its allocator
+   * if the allocator propagates on move assignment. Only
+   * unequal allocators that stay put make the elements move
+   * one by one, which may throw.
+   */
+  auto operator= (vector &&other) noexcept(
+    Traits_::propagate_on_container_move_assignment::value || Traits_::is_always_equal::value
+  ) -> vector & {
+    if (this == &other) return *this;
+    clear();
+    if constexpr (Traits_::propagate_on_container_move_assignment::value) {
+      alloc_ = sjtu::move(other.alloc_);
+      steal_(other);
+      return *this;
+    }
+    if (alloc_ == other.alloc_) {
+      steal_(other);
+      return *this;
+    }
+    // other's buffer cannot be freed by our allocator.
+    grow_(other.size_);
+    relocate(storage_, other.storage_, other.size_);
+    size_ = other.size_;
+    other.size_ = 0;
+    return *this;
+  }
+  auto get_allocator () const -> Allocator {
+    return alloc_;
+  }
   /**
    * assigns specified element with bounds checking
    * throw index_out_of_bound if pos is not in [0, size)
@@ -171,24 +358,31 @@ class vector {
    * throw index_out_of_bound if pos is not in [0, size)
    * !!! Pay attentions
    *   In STL this operator does not check the boundary but I want you to do.
+   *   The check is skipped under unchecked_access.
    */
-  auto operator[] (const size_t &pos) -> T & { return at(pos); }
-  auto operator[] (const size_t &pos) const -> const T & { return at(pos); }
+  auto operator[] (const size_t &pos) -> T & {
+    if constexpr (Access_::kChecked) checkPosition_(pos);
+    return storage_[pos];
+  }
+  auto operator[] (const size_t &pos) const -> const T & {
+    if constexpr (Access_::kChecked) checkPosition_(pos);
+    return storage_[pos];
+  }
   /**
    * access the first element.
    * throw container_is_empty if size == 0
    */
   auto front () const -> const T & {
-    checkNonEmpty_();
-    return at(0);
+    if constexpr (Access_::kChecked) checkNonEmpty_();
+    return storage_[0];
   }
   /**
    * access the last element.
    * throw container_is_empty if size == 0
    */
   auto back () const -> const T & {
-    checkNonEmpty_();
-    return at(size_ - 1);
+    if constexpr (Access_::kChecked) checkNonEmpty_();
+    return storage_[size_ - 1];
   }
   /**
    * returns an iterator to the beginning.
@@ -196,6 +390,9 @@ class vector {
   auto begin () -> iterator {
     return iterator(this, storage_);
   }
+  auto begin () const -> const_iterator {
+    return cbegin();
+  }
   auto cbegin () const -> const_iterator {
     return const_iterator(this, storage_);
   }
@@ -205,6 +402,9 @@ class vector {
   auto end () -> iterator {
     return iterator(this, storage_ + size_);
   }
+  auto end () const -> const_iterator {
+    return cend();
+  }
   auto cend () const -> const_iterator {
     return const_iterator(this, storage_ + size_);
   }
@@ -220,14 +420,53 @@ class vector {
   auto size () const -> size_t {
     return size_;
   }
+  /**
+   * returns the number of elements that can be held without
+   * reallocating.
+   */
+  auto capacity () const -> size_t {
+    return capacity_;
+  }
+  /**
+   * makes room for at least n elements, so that the next
+   * n - size() insertions do not reallocate.
+   */
+  auto reserve (size_t n) -> void {
+    if (n > capacity_) grow_(n);
+  }
+  /**
+   * gives the unused capacity back to the system.
+   */
+  auto shrink_to_fit () -> void {
+    if (capacity_ == size_) return;
+    if (size_ == 0) {
+      clear();
+      return;
+    }
+    grow_(size_);
+  }
+  /**
+   * resizes the container to contain n elements. New
+   * elements are value-initialized, or copies of value.
+   */
+  auto resize (size_t n) -> void {
+    if (n <= size_) return truncate_(n);
+    reserveFor_(n);
+    for (; size_ < n; ++size_) new(storage_ + size_) T();
+  }
+  auto resize (size_t n, const T &value) -> void {
+    if (n <= size_) return truncate_(n);
+    reserveFor_(n);
+    for (; size_ < n; ++size_) new(storage_ + size_) T(value);
+  }
   /**
    * clears the contents
    */
   auto clear () -> void {
     destroyContents_();
-    delete[] reinterpret_cast<char *>(storage_);
-    storage_ = nullptr;
-    capacity_ = 0;
+    release_();
+    storage_ = this->inlineData_();
+    capacity_ = kInline;
     size_ = 0;
   }
   /**
@@ -235,22 +474,110 @@ class vector {
    * returns an iterator pointing to the inserted value.
    */
   auto insert (iterator pos, const T &value) -> iterator { return insert(pos.ptr_ - storage_, value); }
+  auto insert (iterator pos, T &&value) -> iterator { return insert(pos.ptr_ - storage_, sjtu::move(value)); }
   /**
    * inserts value at index ind.
    * after inserting, this->at(ind) == value
    * returns an iterator pointing to the inserted value.
    * throw index_out_of_bound if ind > size (in this situation ind can be size because after inserting the size will increase 1.)
    */
-  auto insert (const size_t &ix, const T &value) -> iterator {
+  auto insert (const size_t &ix, const T &value) -> iterator { return emplace(ix, value); }
+  auto insert (const size_t &ix, T &&value) -> iterator { return emplace(ix, sjtu::move(value)); }
+  /**
+   * constructs an element in place before pos, forwarding
+   * args to its constructor.
+   * returns an iterator pointing to the new element.
+   */
+  template <typename ...Args>
+  auto emplace (iterator pos, Args &&...args) -> iterator {
+    return emplace(pos.ptr_ - storage_, std::forward<Args>(args)...);
+  }
+  /**
+   * constructs an element in place at index ix.
+   * throw index_out_of_bound if ix > size
+   */
+  template <typename ...Args>
+  auto emplace (const size_t &ix, Args &&...args) -> iterator {
     if (ix > size_) throw index_out_of_bound();
-    if (size_ == capacity_) grow_();
-    for (size_t i = size_; i > ix; --i) {
-      storage_[i] = move_(storage_[i - 1]);
+    if (ix == size_) {
+      emplace_back(std::forward<Args>(args)...);
+      return iterator(this, storage_ + ix);
     }
-    storage_[ix] = value;
+    // args may refer to our own elements, which are about to move.
+    T value(std::forward<Args>(args)...);
+    openGap_(ix, 1);
+    new(storage_ + ix) T(sjtu::move(value));
     ++size_;
     return iterator(this, storage_ + ix);
   }
+  /**
+   * inserts n copies of value before pos (or at index ix).
+   * returns an iterator pointing to the first inserted value.
+   */
+  auto insert (iterator pos, size_t n, const T &value) -> iterator {
+    return insert(pos.ptr_ - storage_, n, value);
+  }
+  auto insert (const size_t &ix, size_t n, const T &value) -> iterator {
+    if (ix > size_) throw index_out_of_bound();
+    if (n == 0) return iterator(this, storage_ + ix);
+    // value may be one of our own elements, which are about to move.
+    T copy(value);
+    openGap_(ix, n);
+    fillGap_(ix, n, [&copy] (T *slot, size_t /* i */) { new(slot) T(copy); });
+    return iterator(this, storage_ + ix);
+  }
+  /**
+   * inserts the elements of [first, last) before pos (or at
+   * index ix). first and last must not point into *this.
+   * The tail moves once: O(n + k) for k new elements, even
+   * from single-pass iterators.
+   * returns an iterator pointing to the first inserted value.
+   */
+  template <typename InputIt, typename = std::enable_if_t<!std::is_integral_v<InputIt>>>
+  auto insert (iterator pos, InputIt first, InputIt last) -> iterator {
+    return insert(pos.ptr_ - storage_, first, last);
+  }
+  template <typename InputIt, typename = std::enable_if_t<!std::is_integral_v<InputIt>>>
+  auto insert (const size_t &ix, InputIt first, InputIt last) -> iterator {
+    if (ix > size_) throw index_out_of_bound();
+    if constexpr (kIsForward_<InputIt>) {
+      auto n = static_cast<size_t>(std::distance(first, last));
+      if (n == 0) return iterator(this, storage_ + ix);
+      openGap_(ix, n);
+      fillGap_(ix, n, [&first] (T *slot, size_t /* i */) { new(slot) T(*first++); });
+    } else {
+      // single pass: we cannot know the count beforehand, so
+      // the input is appended, and then rotated into place.
+      size_t sizeOld = size_;
+      try {
+        for (; first != last; ++first) emplace_back(*first);
+      } catch (...) {
+        truncate_(sizeOld);
+        throw;
+      }
+      std::rotate(storage_ + ix, storage_ + sizeOld, storage_ + size_);
+    }
+    return iterator(this, storage_ + ix);
+  }
+  /**
+   * replaces the contents with n copies of value, or with
+   * the elements of [first, last).
+   */
+  auto assign (size_t n, const T &value) -> void {
+    T copy(value);
+    prepareAssign_(n);
+    for (; size_ < n; ++size_) new(storage_ + size_) T(copy);
+  }
+  template <typename InputIt, typename = std::enable_if_t<!std::is_integral_v<InputIt>>>
+  auto assign (InputIt first, InputIt last) -> void {
+    if constexpr (kIsForward_<InputIt>) {
+      prepareAssign_(static_cast<size_t>(std::distance(first, last)));
+      for (; first != last; ++first, ++size_) new(storage_ + size_) T(*first);
+    } else {
+      truncate_(0);
+      for (; first != last; ++first) emplace_back(*first);
+    }
+  }
   /**
    * removes the element at pos.
    * return an iterator pointing to the following element.
@@ -264,20 +591,46 @@ class vector {
    */
   auto erase (const size_t &ix) -> iterator {
     checkPosition_(ix);
-    for (size_t i = ix; i + 1 < size_; ++i) {
-      storage_[i] = move_(storage_[i + 1]);
-    }
-    (storage_ + size_ - 1)->~T();
+    (storage_ + ix)->~T();
+    relocate(storage_ + ix, storage_ + ix + 1, size_ - ix - 1);
     --size_;
     return iterator(this, storage_ + ix);
   }
+  /**
+   * removes the elements in [first, last), moving the tail
+   * only once.
+   * return an iterator pointing to the following element.
+   */
+  auto erase (iterator first, iterator last) -> iterator {
+    size_t ix = first.ptr_ - storage_;
+    size_t n = last.ptr_ - first.ptr_;
+    if (ix + n > size_ || last.ptr_ < first.ptr_) throw index_out_of_bound();
+    destroyContents_(storage_ + ix, n);
+    relocate(storage_ + ix, storage_ + ix + n, size_ - ix - n);
+    size_ -= n;
+    return iterator(this, storage_ + ix);
+  }
   /**
    * adds an element to the end.
    */
-  auto push_back (const T &value) -> void {
-    if (size_ == capacity_) grow_();
-    new(storage_ + size_) T(value);
-    ++size_;
+  auto push_back (const T &value) -> void { emplace_back(value); }
+  auto push_back (T &&value) -> void { emplace_back(sjtu::move(value)); }
+  /**
+   * constructs an element in place at the end, forwarding
+   * args to its constructor.
+   * returns a reference to the new element.
+   */
+  template <typename ...Args>
+  auto emplace_back (Args &&...args) -> T & {
+    if (size_ == capacity_) {
+      // args may refer to our own elements, which are about to move.
+      T value(std::forward<Args>(args)...);
+      grow_();
+      new(storage_ + size_) T(sjtu::move(value));
+    } else {
+      new(storage_ + size_) T(std::forward<Args>(args)...);
+    }
+    return storage_[size_++];
   }
   /**
    * remove the last element from the end.
@@ -290,22 +643,54 @@ class vector {
   }
 
  private:
-  static constexpr size_t kSzDefault_ = 4;
+  using Access_ = Access;
+  using Traits_ = std::allocator_traits<Allocator>;
   static constexpr size_t kSzT_ = sizeof(T);
-  T *storage_ = nullptr;
-  size_t capacity_ = 0;
+  T *storage_ = this->inlineData_();
+  size_t capacity_ = kInline;
   size_t size_ = 0;
+  [[no_unique_address]] Allocator alloc_;
 
-  static auto move_ (T &el) -> T && { return reinterpret_cast<T &&>(el); }
-  static auto copyContents_ (T *to, T *from, size_t n) -> void {
-    for (size_t i = 0; i < n; ++i) {
-      to[i] = from[i];
+  static constexpr bool kRelocatable_ = is_trivially_relocatable_v<T>;
+  static constexpr bool kReallocatable_ = kRelocatable_ && internal::can_reallocate_v<Allocator>;
+  template <typename It>
+  static constexpr bool kIsForward_ = std::is_base_of_v<
+    std::forward_iterator_tag,
+    typename std::iterator_traits<It>::iterator_category
+  >;
+  /**
+   * Takes over the contents of other, leaving it empty. We
+   * must be empty and inline. Inline contents cannot change
+   * hands, so they are relocated into our own buffer.
+   */
+  auto steal_ (vector &other) noexcept -> void {
+    size_ = other.size_;
+    other.size_ = 0;
+    if (other.isInline_()) {
+      relocate(storage_, other.storage_, size_);
+      return;
     }
+    storage_ = other.storage_;
+    capacity_ = other.capacity_;
+    other.storage_ = other.inlineData_();
+    other.capacity_ = kInline;
   }
-  static auto moveContents_ (T *to, T *from, size_t n) -> void {
-    for (size_t i = 0; i < n; ++i) {
-      new(to + i) T(move_(from[i]));
-      from[i].~T();
+  auto isInline_ () const -> bool {
+    if constexpr (kInline == 0) return false;
+    return storage_ == const_cast<vector *>(this)->inlineData_();
+  }
+  /// Gives the buffer back to the allocator unless it is inline.
+  auto release_ () -> void {
+    if (!isInline_() && storage_ != nullptr) Traits_::deallocate(alloc_, storage_, capacity_);
+  }
+  /// Copy-constructs n objects from `from` into the raw memory `to`.
+  static auto copyContents_ (T *to, const T *from, size_t n) -> void {
+    if constexpr (std::is_trivially_copyable_v<T>) {
+      if (n > 0) std::memcpy(static_cast<void *>(to), static_cast<const void *>(from), n * kSzT_);
+    } else {
+      for (size_t i = 0; i < n; ++i) {
+        new(to + i) T(from[i]);
+      }
     }
   }
   static auto destroyContents_ (T *array, size_t n) -> void {
@@ -314,17 +699,100 @@ class vector {
     }
   }
   auto destroyContents_ () -> void { destroyContents_(storage_, size_); }
+  /**
+   * Moves the contents into a buffer of capNew elements.
+   * Relocatable types are moved with a single reallocate
+   * when the allocator offers one, which may even extend the
+   * buffer in place; otherwise the contents are relocated
+   * into a fresh buffer.
+   */
   auto grow_ (size_t capNew) -> void {
-    T *storeNew = reinterpret_cast<T *>(new char[capNew * kSzT_]);
-    if (storage_ != nullptr) {
-      moveContents_(storeNew, storage_, size_);
-      delete[] reinterpret_cast<char *>(storage_);
+    if constexpr (kInline > 0) {
+      if (capNew <= kInline) {
+        // shrinking back into the inline buffer.
+        if (isInline_()) return;
+        T *storeNew = this->inlineData_();
+        relocate(storeNew, storage_, size_);
+        release_();
+        storage_ = storeNew;
+        capacity_ = kInline;
+        return;
+      }
+    }
+    if constexpr (kReallocatable_) {
+      if (storage_ != nullptr && !isInline_()) {
+        storage_ = alloc_.reallocate(storage_, capacity_, capNew);
+        capacity_ = capNew;
+        return;
+      }
     }
+    T *storeNew = allocate_(capNew);
+    relocate(storeNew, storage_, size_);
+    release_();
     storage_ = storeNew;
     capacity_ = capNew;
   }
   auto grow_ () -> void {
-    grow_(storage_ == nullptr ? kSzDefault_ : 2 * capacity_);
+    grow_(Growth::next(capacity_, size_ + 1, kSzT_));
+  }
+  /// Grows by the policy if n elements would not fit.
+  auto reserveFor_ (size_t n) -> void {
+    if (n > capacity_) grow_(Growth::next(capacity_, n, kSzT_));
+  }
+  auto allocate_ (size_t n) -> T * {
+    return n == 0 ? nullptr : Traits_::allocate(alloc_, n);
+  }
+  /**
+   * Opens a gap of n raw slots at index ix, relocating the
+   * tail exactly once and growing at most once. size_ is
+   * left untouched; see fillGap_.
+   */
+  auto openGap_ (size_t ix, size_t n) -> void {
+    if (size_ + n <= capacity_) {
+      relocate(storage_ + ix + n, storage_ + ix, size_ - ix);
+      return;
+    }
+    // appending: the tail is empty, so realloc is the cheapest.
+    if (ix == size_) return reserveFor_(size_ + n);
+    size_t capNew = Growth::next(capacity_, size_ + n, kSzT_);
+    T *storeNew = allocate_(capNew);
+    relocate(storeNew, storage_, ix);
+    relocate(storeNew + ix + n, storage_ + ix, size_ - ix);
+    release_();
+    storage_ = storeNew;
+    capacity_ = capNew;
+  }
+  /**
+   * Constructs the gap opened by openGap_ with
+   * construct(slot, i) and accounts for it in size_. If a
+   * construction throws, the gap is closed again.
+   */
+  template <typename Construct>
+  auto fillGap_ (size_t ix, size_t n, Construct construct) -> void {
+    size_t i = 0;
+    try {
+      for (; i < n; ++i) construct(storage_ + ix + i, i);
+    } catch (...) {
+      destroyContents_(storage_ + ix, i);
+      relocate(storage_ + ix, storage_ + ix + n, size_ - ix);
+      throw;
+    }
+    size_ += n;
+  }
+  /// Empties the vector and makes room for exactly n elements.
+  auto prepareAssign_ (size_t n) -> void {
+    truncate_(0);
+    if (n <= capacity_) return;
+    release_();
+    storage_ = this->inlineData_();
+    capacity_ = kInline;
+    storage_ = allocate_(n);
+    capacity_ = n;
+  }
+  /// Destroys the elements from index n on.
+  auto truncate_ (size_t n) -> void {
+    destroyContents_(storage_ + n, size_ - n);
+    size_ = n;
   }
   auto checkPosition_ (size_t pos) const -> void {
     // since this is size_t which is unsigned, we could not have pos < 0.
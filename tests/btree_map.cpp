@@ -0,0 +1,144 @@
+// btree_map against std::map on random operations, with
+// the B+-tree invariants checked along the way. Small nodes
+// make the trees deep, so that splits, borrows and merges
+// of inner nodes all happen.
+#include "test.hpp"
+#include "map.hpp"
+
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Ref = std::map<int, std::string>;
+
+template <typename Map>
+auto check (const Map &map, const Ref &ref) -> void {
+  CHECK(map.valid());
+  CHECK(test::same(map, ref));
+  // backwards, too.
+  auto it = map.cend();
+  for (auto entry = ref.rbegin(); entry != ref.rend(); ++entry) {
+    --it;
+    CHECK(it->first == entry->first);
+  }
+  CHECK(it == map.cbegin());
+}
+
+template <typename Map>
+auto run (std::mt19937 &rng, int keys) -> void {
+  for (int round = 0; round < 20; ++round) {
+    Map map;
+    Ref ref;
+    for (int op = 0; op < 5000; ++op) {
+      int key = static_cast<int>(rng() % static_cast<unsigned>(keys));
+      std::string value = std::to_string(op);
+      switch (rng() % 12) {
+        case 0: case 1: case 2:
+          map[key] = value;
+          ref[key] = value;
+          break;
+        case 3:
+          CHECK(map.insert(sjtu::pair<const int, std::string>(key, value)).second == ref.emplace(key, value).second);
+          break;
+        case 4: {
+          auto hint = map.lower_bound(key);
+          auto it = map.emplace_hint(hint, key, value);
+          ref.emplace(key, value);
+          CHECK(it->first == key && it->second == ref[key]);
+          break;
+        }
+        case 5: case 6: case 7:
+          CHECK(map.erase(key) == ref.erase(key));
+          break;
+        case 8: {
+          auto it = map.find(key);
+          CHECK((it == map.end()) == (ref.count(key) == 0));
+          if (it != map.end()) {
+            map.erase(it);
+            ref.erase(key);
+          }
+          break;
+        }
+        case 9: {
+          auto lower = map.lower_bound(key);
+          auto upper = map.upper_bound(key + keys / 20);
+          auto refLower = ref.lower_bound(key);
+          auto refUpper = ref.upper_bound(key + keys / 20);
+          CHECK((lower == map.end()) == (refLower == ref.end()));
+          if (refLower != ref.end()) CHECK(lower->first == refLower->first);
+          CHECK((upper == map.end()) == (refUpper == ref.end()));
+          if (refUpper != ref.end()) CHECK(upper->first == refUpper->first);
+          if (op % 4 == 0) {
+            auto next = map.erase(lower, upper);
+            ref.erase(refLower, refUpper);
+            CHECK((next == map.end()) == (refUpper == ref.end()));
+          }
+          break;
+        }
+        case 10:
+          if (op % 10 == 0) {
+            map.erase_if([key] (const auto &entry) { return entry.first % 5 == key % 5; });
+            for (auto it = ref.begin(); it != ref.end();) it = it->first % 5 == key % 5 ? ref.erase(it) : std::next(it);
+          }
+          break;
+        default:
+          if (op % 100 == 0) {
+            Map copy(map);
+            check(copy, ref);
+            map.clear();
+            map = copy;
+          }
+      }
+      if (op % 250 == 0) check(map, ref);
+    }
+    check(map, ref);
+  }
+}
+
+/// Builds from sorted and unsorted ranges of n elements.
+template <typename Map>
+auto build (std::mt19937 &rng, int n) -> void {
+  std::vector<int> keys;
+  Ref ref;
+  for (int i = 0; i < n; ++i) {
+    keys.push_back(i * 3);
+    ref.emplace(i * 3, std::to_string(i));
+  }
+  std::vector<sjtu::pair<const int, std::string>> values;
+  for (int key : keys) values.emplace_back(key, ref[key]);
+  Map sorted(values.begin(), values.end());
+  check(sorted, ref);
+  for (size_t i = keys.size(); i > 1; --i) std::swap(keys[i - 1], keys[rng() % i]);
+  values.clear();
+  for (int key : keys) values.emplace_back(key, ref[key]);
+  Map shuffled(values.begin(), values.end());
+  check(shuffled, ref);
+  // then shrinks it away, which merges every level.
+  for (auto it = ref.begin(); it != ref.end(); it = ref.erase(it)) {
+    CHECK(shuffled.erase(it->first) == 1);
+    if (it->first % 97 == 0) CHECK(shuffled.valid());
+  }
+  CHECK(shuffled.empty() && shuffled.valid());
+}
+
+template <typename Key, typename Value>
+using SmallNodeMap = sjtu::map<Key, Value, std::less<Key>, sjtu::allocator<sjtu::pair<const Key, Value>>, panic::BTreeEngine<64>>;
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  std::mt19937 rng(test::seedArg(argc, argv));
+  run<sjtu::btree_map<int, std::string>>(rng, 2000);
+  run<SmallNodeMap<int, std::string>>(rng, 2000);
+  run<SmallNodeMap<int, std::string>>(rng, 100);
+  for (int n : { 0, 1, 4, 5, 100, 10000 }) {
+    build<sjtu::btree_map<int, std::string>>(rng, n);
+    build<SmallNodeMap<int, std::string>>(rng, n);
+  }
+  std::puts("btree_map ok");
+}
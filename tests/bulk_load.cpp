@@ -0,0 +1,118 @@
+// The range constructor of map against std::map, for sorted,
+// unsorted and duplicate-containing ranges of 0, 1, 2 and
+// 2^k - 1, 2^k + 1 values, read through forward and through
+// single-pass input iterators: the red-black invariants,
+// the order and size, and that the first of equivalent keys
+// is kept.
+#include "test.hpp"
+#include "map.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <random>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Value = sjtu::pair<int, int>;
+using Ref = std::map<int, int>;
+
+/// Reads a vector once, front to back, as an input iterator.
+class SinglePass {
+ public:
+  using iterator_category = std::input_iterator_tag;
+  using value_type = Value;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const Value *;
+  using reference = const Value &;
+  SinglePass () = default;
+  SinglePass (const std::vector<Value> &values, size_t *shared) : values_(&values), index_(shared) {}
+  auto operator* () const -> const Value & { return (*values_)[*index_]; }
+  auto operator-> () const -> const Value * { return &**this; }
+  auto operator++ () -> SinglePass & {
+    ++*index_;
+    return *this;
+  }
+  auto operator== (const SinglePass &rhs) const -> bool { return atEnd_() == rhs.atEnd_(); }
+  auto operator!= (const SinglePass &rhs) const -> bool { return !(*this == rhs); }
+
+ private:
+  const std::vector<Value> *values_ = nullptr;
+  // shared among the copies, so that the range is consumed once.
+  size_t *index_ = nullptr;
+  auto atEnd_ () const -> bool { return values_ == nullptr || *index_ == values_->size(); }
+};
+
+template <typename Map>
+auto check (const Map &map, const Ref &ref) -> void {
+  CHECK(map.valid());
+  CHECK(test::same(map, ref));
+  if constexpr (std::is_same_v<Map, sjtu::ranked_map<int, int>>) {
+    size_t i = 0;
+    for (const auto &entry : ref) {
+      CHECK(map.nth(i)->first == entry.first);
+      CHECK(map.rank(entry.first) == i++);
+    }
+  }
+}
+
+template <typename Map>
+auto load (const std::vector<std::pair<int, int>> &pairs) -> void {
+  Ref ref;
+  std::vector<Value> values;
+  for (const auto &pair : pairs) {
+    ref.insert(pair);
+    values.emplace_back(pair.first, pair.second);
+  }
+  Map map(values.begin(), values.end());
+  check(map, ref);
+  size_t index = 0;
+  Map single(SinglePass(values, &index), SinglePass());
+  CHECK(index == values.size());
+  check(single, ref);
+  // still a plain map afterwards.
+  for (int i = -2; i < 3; ++i) {
+    map[i * 1000] = i;
+    ref[i * 1000] = i;
+  }
+  check(map, ref);
+}
+
+template <typename Map>
+auto run (std::mt19937 &rng) -> void {
+  std::vector<size_t> sizes = { 0, 1, 2, 3 };
+  for (size_t k = 2; k <= 12; ++k) {
+    sizes.push_back((size_t(1) << k) - 1);
+    sizes.push_back((size_t(1) << k) + 1);
+  }
+  for (size_t n : sizes) {
+    std::vector<std::pair<int, int>> values;
+    for (size_t i = 0; i < n; ++i) values.emplace_back(static_cast<int>(i) * 3, static_cast<int>(rng() % 100));
+    load<Map>(values);
+    std::reverse(values.begin(), values.end());
+    load<Map>(values);
+    std::shuffle(values.begin(), values.end(), rng);
+    load<Map>(values);
+    // sorted with duplicates next to each other, and duplicates anywhere.
+    std::vector<std::pair<int, int>> sorted;
+    for (size_t i = 0; i < n; ++i) {
+      int key = static_cast<int>(i / 3);
+      sorted.emplace_back(key, static_cast<int>(i));
+    }
+    load<Map>(sorted);
+    for (auto &value : values) value.first %= static_cast<int>(n / 2 + 1) * 3;
+    load<Map>(values);
+  }
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  std::mt19937 rng(test::seedArg(argc, argv));
+  run<sjtu::map<int, int>>(rng);
+  run<sjtu::ranked_map<int, int>>(rng);
+  std::puts("bulk_load ok");
+}
@@ -0,0 +1,140 @@
+// concurrent_map against std::map on one thread, and then
+// with readers racing writers: every read must see whole
+// updates, in order. Build with SANITIZE=-fsanitize=thread
+// to have the races checked, too.
+#include "test.hpp"
+#include "concurrent_map.hpp"
+
+#include <atomic>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Map = sjtu::concurrent_map<int, int>;
+using Ref = std::map<int, int>;
+
+auto sequential (std::mt19937 &rng) -> void {
+  Map map;
+  Ref ref;
+  std::vector<Map::snapshot_type> snapshots;
+  std::vector<Ref> refs;
+  for (int op = 0; op < 5000; ++op) {
+    int key = static_cast<int>(rng() % 200);
+    switch (rng() % 6) {
+      case 0: case 1:
+        CHECK(map.insert(sjtu::pair<const int, int>(key, op)) == ref.emplace(key, op).second);
+        break;
+      case 2:
+        CHECK(map.erase(key) == ref.erase(key));
+        break;
+      case 3:
+        map.update([&] (Map::snapshot_type &version) {
+          for (int i = key; i < key + 10; ++i) version[i] += op;
+        });
+        for (int i = key; i < key + 10; ++i) ref[i] += op;
+        break;
+      case 4:
+        if (ref.count(key) == 0) {
+          bool threw = false;
+          try {
+            map.at(key);
+          } catch (sjtu::index_out_of_bound &) {
+            threw = true;
+          }
+          CHECK(threw);
+        } else {
+          CHECK(map.at(key) == ref.at(key));
+        }
+        CHECK(map.count(key) == ref.count(key));
+        break;
+      default:
+        if (op % 20 == 0) {
+          snapshots.push_back(map.snapshot());
+          refs.push_back(ref);
+        }
+    }
+    CHECK(map.size() == ref.size() && map.empty() == ref.empty());
+  }
+  CHECK(map.read([&] (const Map::snapshot_type &version) { return test::same(version, ref); }));
+  // the snapshots are as they were taken.
+  for (size_t i = 0; i < snapshots.size(); ++i) CHECK(test::same(snapshots[i], refs[i]));
+
+  // an update that throws publishes nothing.
+  size_t size = map.size();
+  bool threw = false;
+  try {
+    map.update([] (Map::snapshot_type &version) {
+      version[-1] = 1;
+      version.clear();
+      throw sjtu::runtime_error();
+    });
+  } catch (sjtu::runtime_error &) {
+    threw = true;
+  }
+  CHECK(threw && map.size() == size && map.count(-1) == 0);
+}
+
+auto concurrent () -> void {
+  constexpr int kKeys = 100;
+  constexpr int kUpdates = 200;
+  constexpr int kReaders = 4;
+  Map map;
+  map.update([] (Map::snapshot_type &version) {
+    for (int i = 0; i < kKeys; ++i) version[i] = 0;
+  });
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> readers;
+  for (int t = 0; t < kReaders; ++t) {
+    readers.emplace_back([&, t] {
+      int last = 0;
+      std::vector<Map::snapshot_type> kept;
+      while (!stop.load()) {
+        // all the keys below kKeys have the value of one update, never older than the last seen.
+        int seen = map.read([&] (const Map::snapshot_type &version) {
+          int value = version.at(0);
+          for (const auto &entry : version) {
+            if (entry.first < kKeys) CHECK(entry.second == value);
+          }
+          return value;
+        });
+        CHECK(seen >= last);
+        last = seen;
+        CHECK(map.at(kKeys - 1) >= last);
+        if (t % 2 == 1) {
+          // snapshots outlive the versions, and are freed on this thread.
+          kept.push_back(map.snapshot());
+          if (kept.size() > 8) kept.erase(kept.begin());
+          CHECK(kept.back().size() >= static_cast<size_t>(kKeys));
+        }
+      }
+    });
+  }
+  std::thread extra([&] {
+    // a second writer, of keys the readers do not check.
+    for (int i = 0; i < kUpdates; ++i) {
+      CHECK(map.insert(sjtu::pair<const int, int>(kKeys + i, i)));
+      if (i % 2 == 0) CHECK(map.erase(kKeys + i) == 1);
+    }
+  });
+  for (int w = 1; w <= kUpdates; ++w) {
+    map.update([w] (Map::snapshot_type &version) {
+      for (int i = 0; i < kKeys; ++i) version[i] = w;
+    });
+  }
+  extra.join();
+  stop.store(true);
+  for (auto &reader : readers) reader.join();
+  CHECK(map.at(0) == kUpdates && map.size() == static_cast<size_t>(kKeys + kUpdates / 2));
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  std::mt19937 rng(test::seedArg(argc, argv));
+  sequential(rng);
+  concurrent();
+  std::puts("concurrent_map ok");
+}
@@ -0,0 +1,48 @@
+// Building a large map in ascending and in descending order,
+// which rebalances at the same edge all the time, then
+// looking every key up, copying it and tearing both down,
+// all on a thread with a small stack: none of these walks
+// may take stack in proportion to the size or height.
+#include "test.hpp"
+#include "map.hpp"
+
+#include <pthread.h>
+#include <string>
+
+namespace {
+
+constexpr size_t kStackSize = size_t(64) << 10;
+constexpr int kSize = 1000000;
+
+auto build (bool ascending) -> void {
+  auto *map = new sjtu::map<int, std::string>;
+  for (int i = 0; i < kSize; ++i) {
+    int key = ascending ? i : kSize - 1 - i;
+    (*map)[key] = std::to_string(key);
+  }
+  CHECK(map->size() == static_cast<size_t>(kSize) && map->valid());
+  for (int i = 0; i < kSize; i += 7) CHECK(map->find(i)->second == std::to_string(i));
+  auto *copy = new sjtu::map<int, std::string>(*map);
+  delete map;
+  CHECK(copy->size() == static_cast<size_t>(kSize) && copy->cbegin()->first == 0);
+  delete copy;
+}
+
+auto body (void * /* unused */) -> void * {
+  build(true);
+  build(false);
+  return nullptr;
+}
+
+} // namespace
+
+auto main () -> int {
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, kStackSize);
+  pthread_t thread;
+  CHECK(pthread_create(&thread, &attr, body, nullptr) == 0);
+  pthread_join(thread, nullptr);
+  pthread_attr_destroy(&attr);
+  std::puts("deep_tree ok");
+}
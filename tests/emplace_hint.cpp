@@ -0,0 +1,161 @@
+// map::emplace_hint and insert with a hint against std::map:
+// right and wrong hints, end() while appending, and a key
+// that is already there, for plain, ranked and B+-tree
+// maps; and the cached rightmost node, through appends at
+// end() after the maximum is erased, after split_at and
+// after splice.
+#include "test.hpp"
+#include "map.hpp"
+
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+
+namespace {
+
+using Ref = std::map<int, std::string>;
+
+template <typename Map>
+auto check (const Map &map, const Ref &ref) -> void {
+  CHECK(map.valid());
+  CHECK(test::same(map, ref));
+}
+
+/// The iterator of map at the same position as it in ref.
+template <typename Map>
+auto at (Map &map, const Ref &ref, Ref::const_iterator it) -> typename Map::const_iterator {
+  if (it == ref.cend()) return map.cend();
+  return map.find(it->first);
+}
+
+template <typename Map>
+auto hints (std::mt19937 &rng) -> void {
+  Map map;
+  Ref ref;
+  // ascending keys, each appended at end().
+  for (int i = 0; i < 2000; i += 2) {
+    auto it = map.emplace_hint(map.cend(), i, std::to_string(i));
+    ref.emplace_hint(ref.cend(), i, std::to_string(i));
+    CHECK(it->first == i && it->second == std::to_string(i));
+  }
+  check(map, ref);
+  for (int round = 0; round < 3000; ++round) {
+    int key = static_cast<int>(rng() % 2100) - 50;
+    std::string value = "v" + std::to_string(round);
+    Ref::const_iterator hint;
+    switch (rng() % 4) {
+      case 0:
+        // right before the hint, or right after it.
+        hint = ref.lower_bound(key);
+        if (rng() % 2 == 0 && hint != ref.cbegin()) --hint;
+        break;
+      case 1:
+        // anywhere.
+        hint = std::next(ref.cbegin(), static_cast<std::ptrdiff_t>(rng() % (ref.size() + 1)));
+        break;
+      case 2:
+        hint = ref.cend();
+        break;
+      default:
+        hint = ref.cbegin();
+    }
+    bool had = ref.count(key) != 0;
+    std::string before = had ? ref.at(key) : "";
+    auto mapHint = at(map, ref, hint);
+    auto it = rng() % 2 == 0
+      ? map.emplace_hint(mapHint, key, value)
+      : map.insert(mapHint, typename Map::value_type(key, value));
+    ref.emplace_hint(hint, key, value);
+    // the element with the key, where an existing one keeps its value.
+    CHECK(it->first == key && it->second == (had ? before : value));
+    if (round % 100 == 0) check(map, ref);
+  }
+  check(map, ref);
+  // appending again after all that.
+  for (int i = 0; i < 100; ++i) {
+    map.emplace_hint(map.cend(), 3000 + i, "end");
+    ref.emplace(3000 + i, "end");
+  }
+  check(map, ref);
+}
+
+/// Appends at end(), which takes the cached rightmost node as the place to go.
+template <typename Map>
+auto append (Map &map, Ref &ref, int from, int count) -> void {
+  for (int i = from; i < from + count; ++i) {
+    auto it = map.emplace_hint(map.cend(), i, "a" + std::to_string(i));
+    ref.emplace(i, "a" + std::to_string(i));
+    CHECK(it->first == i && ++it == map.end());
+  }
+  check(map, ref);
+}
+
+template <typename Map>
+auto rightmost () -> void {
+  Map map;
+  Ref ref;
+  append(map, ref, 0, 100);
+  // erasing the maximum, one by one and by range.
+  for (int i = 0; i < 10; ++i) {
+    auto last = map.end();
+    map.erase(--last);
+    ref.erase(std::prev(ref.end()));
+    check(map, ref);
+    append(map, ref, ref.rbegin()->first + 1, i % 2);
+  }
+  map.erase(map.find(50), map.cend());
+  ref.erase(ref.find(50), ref.end());
+  append(map, ref, 50, 10);
+  // appends between the rest and the old maximum.
+  map.erase(map.find(55));
+  ref.erase(55);
+  map.emplace_hint(map.cend(), 55, "back");
+  ref.emplace(55, "back");
+  check(map, ref);
+
+  // split_at moves the maximum away, and splice brings it back.
+  Map rest = map.split_at(30);
+  Ref refRest(ref.find(30), ref.end());
+  ref.erase(ref.find(30), ref.end());
+  check(map, ref);
+  check(rest, refRest);
+  append(rest, refRest, 1000, 5);
+  // the maximum of map is 29 now, so 30 to 39 go at its end.
+  append(map, ref, 30, 10);
+  Map low = map.split_at(10);
+  Ref refLow(ref.find(10), ref.end());
+  ref.erase(ref.find(10), ref.end());
+  check(map, ref);
+  map.splice(low);
+  ref.insert(refLow.begin(), refLow.end());
+  check(map, ref);
+  // rest has the keys appended to map since; without them, it goes back on top.
+  for (int key : { 30, 31, 32, 33, 34, 35, 36, 37, 38, 39 }) {
+    rest.erase(rest.find(key));
+    refRest.erase(key);
+  }
+  map.splice(rest);
+  ref.insert(refRest.begin(), refRest.end());
+  check(map, ref);
+  append(map, ref, 2000, 5);
+  // and splicing in a lower map keeps the maximum.
+  Map lower;
+  Ref refLower;
+  append(lower, refLower, -20, 10);
+  map.splice(lower);
+  ref.insert(refLower.begin(), refLower.end());
+  append(map, ref, 3000, 5);
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  std::mt19937 rng(test::seedArg(argc, argv));
+  hints<sjtu::map<int, std::string>>(rng);
+  hints<sjtu::ranked_map<int, std::string>>(rng);
+  hints<sjtu::btree_map<int, std::string>>(rng);
+  rightmost<sjtu::map<int, std::string>>();
+  rightmost<sjtu::ranked_map<int, std::string>>();
+  std::puts("emplace_hint ok");
+}
@@ -0,0 +1,141 @@
+// frozen_map against std::map at the sizes where the
+// Eytzinger layout changes shape, 2^k - 1, 2^k and 2^k + 1,
+// and on random data: every lookup, from below the minimum
+// to above the maximum, and iteration both ways.
+#include "test.hpp"
+#include "frozen_map.hpp"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+template <typename Frozen, typename Ref, typename It, typename RefIt>
+auto sameAt (const Frozen &frozen, const Ref &ref, It it, RefIt refIt) -> bool {
+  if ((it == frozen.cend()) != (refIt == ref.cend())) return false;
+  return refIt == ref.cend() || (it->first == refIt->first && it->second == refIt->second);
+}
+
+/// Looks up every key in [lo, hi], present or not.
+template <typename Frozen, typename Ref, typename MakeKey>
+auto lookups (const Frozen &frozen, const Ref &ref, int lo, int hi, MakeKey makeKey) -> void {
+  for (int i = lo; i <= hi; ++i) {
+    auto key = makeKey(i);
+    CHECK(sameAt(frozen, ref, frozen.find(key), ref.find(key)));
+    CHECK(sameAt(frozen, ref, frozen.lower_bound(key), ref.lower_bound(key)));
+    CHECK(sameAt(frozen, ref, frozen.upper_bound(key), ref.upper_bound(key)));
+    auto range = frozen.equal_range(key);
+    CHECK(range.first == frozen.lower_bound(key) && range.second == frozen.upper_bound(key));
+    CHECK(frozen.count(key) == ref.count(key));
+    if (ref.count(key) == 0) {
+      bool threw = false;
+      try {
+        frozen.at(key);
+      } catch (sjtu::index_out_of_bound &) {
+        threw = true;
+      }
+      CHECK(threw);
+    } else {
+      CHECK(frozen.at(key) == ref.at(key));
+    }
+  }
+}
+
+template <typename Frozen, typename Ref>
+auto iteration (const Frozen &frozen, const Ref &ref) -> void {
+  CHECK(frozen.size() == ref.size() && frozen.empty() == ref.empty());
+  CHECK(test::same(frozen, ref));
+  auto it = frozen.cend();
+  for (auto entry = ref.rbegin(); entry != ref.rend(); ++entry) {
+    --it;
+    CHECK(it->first == entry->first && it->second == entry->second);
+  }
+  CHECK(it == frozen.cbegin());
+  bool threw = false;
+  try {
+    --it;
+  } catch (sjtu::invalid_iterator &) {
+    threw = true;
+  }
+  CHECK(threw);
+  threw = false;
+  try {
+    auto end = frozen.cend();
+    ++end;
+  } catch (sjtu::invalid_iterator &) {
+    threw = true;
+  }
+  CHECK(threw);
+}
+
+/// A frozen map of n distinct even int keys, from a map and from a range with duplicates.
+auto ints (std::mt19937 &rng, size_t n) -> void {
+  std::map<int, int> ref;
+  while (ref.size() < n) ref.emplace(static_cast<int>(rng() % (4 * n + 4)) * 2, static_cast<int>(rng()));
+  sjtu::map<int, int> source;
+  std::vector<int> keys;
+  for (const auto &entry : ref) {
+    source[entry.first] = entry.second;
+    keys.push_back(entry.first);
+  }
+  // out of order, then again with other values: the first one is kept.
+  std::shuffle(keys.begin(), keys.end(), rng);
+  std::vector<sjtu::pair<const int, int>> values;
+  for (int key : keys) values.emplace_back(key, ref[key]);
+  std::shuffle(keys.begin(), keys.end(), rng);
+  for (int key : keys) values.emplace_back(key, ref[key] + 1);
+  sjtu::frozen_map<int, int> frozen(source);
+  sjtu::frozen_map<int, int> ranged(values.begin(), values.end());
+  int lo = ref.empty() ? -4 : ref.begin()->first - 3;
+  int hi = ref.empty() ? 4 : ref.rbegin()->first + 3;
+  auto identity = [] (int i) { return i; };
+  for (const auto *map : { &frozen, &ranged }) {
+    iteration(*map, ref);
+    lookups(*map, ref, lo, hi, identity);
+  }
+  sjtu::frozen_map<int, int> copy(frozen);
+  iteration(copy, ref);
+  copy = sjtu::frozen_map<int, int>();
+  CHECK(copy.empty() && copy.find(0) == copy.cend());
+  copy = ranged;
+  iteration(copy, ref);
+}
+
+/// The same with string keys, which are not trivial.
+auto strings (std::mt19937 &rng, size_t n) -> void {
+  auto makeKey = [] (int i) {
+    std::string key = std::to_string(i);
+    return std::string(6 - key.size(), '0') + key;
+  };
+  std::map<std::string, int> ref;
+  sjtu::map<std::string, int> source;
+  while (ref.size() < n) {
+    int i = static_cast<int>(rng() % (4 * n + 4)) * 2;
+    ref[makeKey(i)] = i;
+    source[makeKey(i)] = i;
+  }
+  sjtu::frozen_map<std::string, int> frozen(source);
+  iteration(frozen, ref);
+  lookups(frozen, ref, -1, static_cast<int>(8 * n + 10), makeKey);
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  std::mt19937 rng(test::seedArg(argc, argv));
+  std::vector<size_t> sizes = { 0, 1, 2 };
+  for (size_t k = 2; k <= 11; ++k) {
+    sizes.push_back((size_t(1) << k) - 1);
+    sizes.push_back(size_t(1) << k);
+    sizes.push_back((size_t(1) << k) + 1);
+  }
+  for (size_t n : sizes) {
+    ints(rng, n);
+    strings(rng, n);
+  }
+  for (int round = 0; round < 20; ++round) ints(rng, rng() % 5000);
+  std::puts("frozen_map ok");
+}
@@ -0,0 +1,156 @@
+// NodePool on its own: the free list, the reserved run and
+// the spare rest of the chunk before it, share and swap,
+// with every allocation counted, so that nothing outlives
+// the last pool using it. ASan catches any use of memory
+// freed too early.
+#include "test.hpp"
+#include "pool.hpp"
+
+#include <random>
+#include <vector>
+
+namespace {
+
+size_t live = 0;
+
+/// sjtu::allocator, counting the blocks it has handed out and not taken back.
+template <typename T>
+class CountingAllocator : public sjtu::allocator<T> {
+ public:
+  CountingAllocator () = default;
+  template <typename U>
+  CountingAllocator (const CountingAllocator<U> &/* unused */) noexcept {}
+  auto allocate (size_t n) -> T * {
+    ++live;
+    return sjtu::allocator<T>::allocate(n);
+  }
+  auto deallocate (T *p, size_t n) noexcept -> void {
+    --live;
+    sjtu::allocator<T>::deallocate(p, n);
+  }
+  template <typename U>
+  struct rebind {
+    using other = CountingAllocator<U>;
+  };
+};
+
+struct Object {
+  long payload[3];
+};
+
+using Pool = panic::NodePool<Object, CountingAllocator<Object>>;
+
+/// Takes an object from pool and writes to all of it.
+auto take (Pool &pool, long tag) -> Object * {
+  Object *object = pool.allocate();
+  for (long &word : object->payload) word = tag;
+  return object;
+}
+
+auto freeList () -> void {
+  Pool pool;
+  std::vector<Object *> objects;
+  for (long i = 0; i < 100; ++i) objects.push_back(take(pool, i));
+  // freed objects come back first, most recent first.
+  pool.deallocate(objects[10]);
+  pool.deallocate(objects[20]);
+  CHECK(take(pool, 1) == objects[20] && take(pool, 2) == objects[10]);
+  for (Object *object : objects) pool.deallocate(object);
+  // and nothing new is taken while they last.
+  size_t before = live;
+  for (long i = 0; i < 100; ++i) take(pool, i);
+  CHECK(live == before);
+  pool.release();
+  CHECK(live == 0);
+  // usable again after release.
+  take(pool, 3);
+  CHECK(live > 0);
+}
+
+auto reservedRun () -> void {
+  Pool pool;
+  // the first chunk, of which most is left.
+  Object *first = take(pool, 0);
+  Object *second = take(pool, 1);
+  CHECK(second == first + 1);
+  // a run that fits in what is left takes no new chunk.
+  size_t before = live;
+  pool.reserve(2);
+  CHECK(take(pool, 2) == second + 1 && live == before);
+  second = take(pool, 2);
+  pool.reserve(1000);
+  Object *run = take(pool, 2);
+  for (long i = 1; i < 1000; ++i) CHECK(take(pool, i) == run + i);
+  // then the rest of the first chunk, in order.
+  Object *spare = take(pool, 3);
+  CHECK(spare == second + 1);
+  CHECK(take(pool, 4) == spare + 1);
+}
+
+auto shareAndSwap (std::mt19937 &rng) -> void {
+  {
+    Pool lhs, rhs;
+    Object *mine = take(lhs, 1);
+    Object *theirs = take(rhs, 2);
+    lhs.share(rhs);
+    // sharing the same memory again keeps nothing more.
+    size_t before = live;
+    for (int i = 0; i < 1000; ++i) lhs.share(rhs);
+    CHECK(live == before);
+    // theirs now belongs to lhs, and outlives rhs.
+    rhs.release();
+    CHECK(theirs->payload[2] == 2);
+    lhs.deallocate(theirs);
+    CHECK(take(lhs, 3) == theirs);
+    // rhs does not touch the free list of lhs.
+    take(rhs, 4);
+    lhs.swap(rhs);
+    CHECK(take(rhs, 5) == mine + 1);
+    CHECK(mine->payload[0] == 1 && theirs->payload[0] == 3);
+    lhs.release();
+    CHECK(mine->payload[0] == 1);
+  }
+  CHECK(live == 0);
+
+  // random handing over of objects between pools, which share memory as they go.
+  {
+    Pool pools[4];
+    std::vector<Object *> objects[4];
+    for (int op = 0; op < 20000; ++op) {
+      size_t a = rng() % 4, b = rng() % 4;
+      switch (rng() % 4) {
+        case 0: case 1:
+          objects[a].push_back(take(pools[a], op));
+          break;
+        case 2:
+          if (!objects[a].empty()) {
+            pools[a].deallocate(objects[a].back());
+            objects[a].pop_back();
+          }
+          break;
+        default:
+          if (a != b && !objects[b].empty()) {
+            pools[a].share(pools[b]);
+            objects[a].push_back(objects[b].back());
+            objects[b].pop_back();
+          }
+      }
+    }
+    for (auto &list : objects) {
+      for (Object *object : list) CHECK(object->payload[1] == object->payload[0]);
+    }
+  }
+  CHECK(live == 0);
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  std::mt19937 rng(test::seedArg(argc, argv));
+  freeList();
+  CHECK(live == 0);
+  reservedRun();
+  CHECK(live == 0);
+  shareAndSwap(rng);
+  std::puts("node_pool ok");
+}
@@ -0,0 +1,133 @@
+// persistent_map against std::map, taking snapshots as it
+// goes: writes to any copy, through insert, erase, at and
+// operator[], must leave all the other copies as they were.
+#include "test.hpp"
+#include "persistent_map.hpp"
+
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Map = sjtu::persistent_map<int, std::string>;
+using Ref = std::map<int, std::string>;
+
+auto check (const Map &map, const Ref &ref) -> void {
+  CHECK(map.valid());
+  CHECK(test::same(map, ref));
+  if (!ref.empty()) {
+    auto last = map.cend();
+    --last;
+    CHECK(last->first == ref.rbegin()->first);
+  }
+}
+
+/// A random write to map, mirrored in ref.
+auto write (std::mt19937 &rng, Map &map, Ref &ref, int op) -> void {
+  int key = static_cast<int>(rng() % 300);
+  std::string value = std::to_string(op);
+  switch (rng() % 8) {
+    case 0: case 1:
+      CHECK(map.insert(sjtu::pair<const int, std::string>(key, value)).second == ref.emplace(key, value).second);
+      break;
+    case 2: case 3:
+      map[key] += value;
+      ref[key] += value;
+      break;
+    case 4:
+      if (ref.count(key) == 0) {
+        bool threw = false;
+        try {
+          map.at(key) = value;
+        } catch (sjtu::index_out_of_bound &) {
+          threw = true;
+        }
+        CHECK(threw);
+      } else {
+        map.at(key) = value;
+        ref.at(key) = value;
+      }
+      break;
+    case 5: case 6:
+      CHECK(map.erase(key) == ref.erase(key));
+      break;
+    default: {
+      auto it = map.lower_bound(key);
+      if (it != map.end()) {
+        ref.erase(it->first);
+        map.erase(it);
+      }
+    }
+  }
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  std::mt19937 rng(test::seedArg(argc, argv));
+  for (int round = 0; round < 20; ++round) {
+    std::vector<Map> maps(1);
+    std::vector<Ref> refs(1);
+    for (int op = 0; op < 4000; ++op) {
+      size_t i = rng() % maps.size();
+      if (rng() % 50 == 0) {
+        if (maps.size() < 16) {
+          // a snapshot.
+          maps.push_back(maps[i]);
+          refs.push_back(refs[i]);
+        } else {
+          size_t j = rng() % maps.size();
+          maps[j] = maps[i];
+          refs[j] = refs[i];
+        }
+      } else if (rng() % 500 == 0) {
+        maps[i].clear();
+        refs[i].clear();
+      } else {
+        write(rng, maps[i], refs[i], op);
+      }
+      if (op % 100 == 0) {
+        for (size_t j = 0; j < maps.size(); ++j) check(maps[j], refs[j]);
+      }
+    }
+    for (size_t j = 0; j < maps.size(); ++j) check(maps[j], refs[j]);
+    // drops the snapshots in random order.
+    while (!maps.empty()) {
+      size_t j = rng() % maps.size();
+      maps.erase(maps.begin() + static_cast<std::ptrdiff_t>(j));
+      refs.erase(refs.begin() + static_cast<std::ptrdiff_t>(j));
+      for (size_t k = 0; k < maps.size(); ++k) check(maps[k], refs[k]);
+    }
+  }
+
+  // bounds, on a map sharing all of its nodes.
+  Map map;
+  Ref ref;
+  for (int i = 0; i < 200; ++i) {
+    int key = static_cast<int>(rng() % 500) * 2;
+    map.insert(sjtu::pair<const int, std::string>(key, std::to_string(i)));
+    ref.emplace(key, std::to_string(i));
+  }
+  const Map snapshot(map);
+  for (int key = -1; key <= 1000; ++key) {
+    auto lower = snapshot.lower_bound(key);
+    auto upper = snapshot.upper_bound(key);
+    auto refLower = ref.lower_bound(key);
+    auto refUpper = ref.upper_bound(key);
+    CHECK((lower == snapshot.end()) == (refLower == ref.end()));
+    if (refLower != ref.end()) CHECK(lower->first == refLower->first);
+    CHECK((upper == snapshot.end()) == (refUpper == ref.end()));
+    if (refUpper != ref.end()) CHECK(upper->first == refUpper->first);
+    CHECK(snapshot.count(key) == ref.count(key));
+  }
+  bool threw = false;
+  try {
+    map.erase(map.end());
+  } catch (sjtu::invalid_iterator &) {
+    threw = true;
+  }
+  CHECK(threw);
+  std::puts("persistent_map ok");
+}
@@ -0,0 +1,80 @@
+// ranked_map::nth and rank against positions in std::map,
+// through random insertions, erasures and copies.
+#include "test.hpp"
+#include "map.hpp"
+
+#include <iterator>
+#include <map>
+#include <random>
+
+namespace {
+
+using Map = sjtu::ranked_map<int, int>;
+using Ref = std::map<int, int>;
+
+auto checkRanks (const Map &map, const Ref &ref) -> void {
+  CHECK(map.valid());
+  CHECK(test::same(map, ref));
+  size_t i = 0;
+  for (const auto &entry : ref) {
+    auto it = map.nth(i);
+    CHECK(it != map.cend() && it->first == entry.first);
+    CHECK(map.rank(entry.first) == i);
+    // the keys in between are all even, so that odd ones are missing.
+    CHECK(map.rank(entry.first + 1) == i + 1);
+    ++i;
+  }
+  CHECK(map.nth(ref.size()) == map.cend());
+  CHECK(map.rank(-1) == 0);
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  std::mt19937 rng(test::seedArg(argc, argv));
+  for (int round = 0; round < 50; ++round) {
+    Map map;
+    Ref ref;
+    for (int op = 0; op < 2000; ++op) {
+      int key = static_cast<int>(rng() % 1000) * 2;
+      switch (rng() % 8) {
+        case 0: case 1: case 2:
+          map[key] = op;
+          ref[key] = op;
+          break;
+        case 3:
+          CHECK(map.insert(sjtu::pair<const int, int>(key, op)).second == ref.emplace(key, op).second);
+          break;
+        case 4: case 5:
+          if (!ref.empty()) {
+            // erases by position.
+            size_t index = rng() % ref.size();
+            map.erase(map.nth(index));
+            ref.erase(std::next(ref.begin(), static_cast<std::ptrdiff_t>(index)));
+          }
+          break;
+        case 6: {
+          auto it = map.find(key);
+          if (it != map.end()) map.erase(it);
+          ref.erase(key);
+          break;
+        }
+        default:
+          if (op % 50 == 0) {
+            Map copy(map);
+            checkRanks(copy, ref);
+            map = copy;
+          }
+      }
+      if (op % 200 == 0) checkRanks(map, ref);
+    }
+    checkRanks(map, ref);
+    map.erase_if([] (const auto &entry) { return entry.first % 3 == 0; });
+    for (auto it = ref.begin(); it != ref.end();) it = it->first % 3 == 0 ? ref.erase(it) : std::next(it);
+    checkRanks(map, ref);
+    map.erase(map.nth(ref.size() / 4), map.nth(ref.size() / 2));
+    ref.erase(std::next(ref.begin(), static_cast<std::ptrdiff_t>(ref.size() / 4)), std::next(ref.begin(), static_cast<std::ptrdiff_t>(ref.size() / 2)));
+    checkRanks(map, ref);
+  }
+  std::puts("ranked_map ok");
+}
@@ -0,0 +1,139 @@
+// map::merge_from, intersect_with and subtract against
+// their definitions on std::map, checking the red-black
+// invariants of both operands afterwards, on one thread and
+// on several, for plain and ranked maps; and map::assign,
+// which copies on several threads too.
+#include "test.hpp"
+#include "map.hpp"
+
+#include <map>
+#include <memory_resource>
+#include <random>
+#include <type_traits>
+#include <utility>
+
+namespace {
+
+using Ref = std::map<int, int>;
+
+template <typename Map>
+auto check (const Map &map, const Ref &ref) -> void {
+  CHECK(map.valid());
+  CHECK(test::same(map, ref));
+  if constexpr (std::is_same_v<Map, sjtu::ranked_map<int, int>>) {
+    size_t i = 0;
+    for (const auto &entry : ref) {
+      CHECK(map.nth(i)->first == entry.first);
+      CHECK(map.rank(entry.first) == i++);
+    }
+  }
+}
+
+template <typename Map>
+auto run (std::mt19937 &rng, int rounds, int maxSize, size_t threads) -> void {
+  for (int round = 0; round < rounds; ++round) {
+    Map lhs, rhs;
+    Ref lhsRef, rhsRef;
+    // operands of similar or very different sizes, over dense or sparse keys.
+    int lhsSize = static_cast<int>(rng() % static_cast<unsigned>(maxSize));
+    int rhsSize = static_cast<int>(rng() % static_cast<unsigned>(rng() % 2 == 0 ? maxSize : maxSize / 20 + 1));
+    unsigned range = static_cast<unsigned>(rng() % 2 == 0 ? maxSize * 2 : maxSize * 10);
+    for (int i = 0; i < lhsSize; ++i) {
+      int key = static_cast<int>(rng() % range);
+      lhs[key] = i;
+      lhsRef[key] = i;
+    }
+    for (int i = 0; i < rhsSize; ++i) {
+      int key = static_cast<int>(rng() % range);
+      rhs[key] = -i;
+      rhsRef[key] = -i;
+    }
+    if (rng() % 2 == 0) {
+      std::swap(lhs, rhs);
+      std::swap(lhsRef, rhsRef);
+    }
+    Map copy;
+    copy[-3] = 3;
+    copy.assign(lhs, threads);
+    check(copy, lhsRef);
+    Ref expected;
+    switch (rng() % 3) {
+      case 0: {
+        Ref left;
+        expected = lhsRef;
+        for (const auto &entry : rhsRef) {
+          if (!expected.emplace(entry).second) left.insert(entry);
+        }
+        lhs.merge_from(rhs, threads);
+        check(lhs, expected);
+        check(rhs, left);
+        // both stay usable.
+        lhs[-1] = 1;
+        rhs[-2] = 2;
+        expected[-1] = 1;
+        left[-2] = 2;
+        check(lhs, expected);
+        check(rhs, left);
+        break;
+      }
+      case 1:
+        for (const auto &entry : lhsRef) {
+          if (rhsRef.count(entry.first) != 0) expected.insert(entry);
+        }
+        lhs.intersect_with(rhs, threads);
+        check(lhs, expected);
+        check(rhs, rhsRef);
+        break;
+      default:
+        for (const auto &entry : lhsRef) {
+          if (rhsRef.count(entry.first) == 0) expected.insert(entry);
+        }
+        lhs.subtract(rhs, threads);
+        check(lhs, expected);
+        check(rhs, rhsRef);
+    }
+  }
+
+  // with itself.
+  Map map;
+  Ref ref;
+  for (int i = 0; i < 100; ++i) {
+    map[i] = i;
+    ref[i] = i;
+  }
+  map.intersect_with(map, threads);
+  check(map, ref);
+  map.merge_from(map, threads);
+  check(map, ref);
+  map.subtract(map, threads);
+  check(map, Ref());
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  std::mt19937 rng(test::seedArg(argc, argv));
+  run<sjtu::map<int, int>>(rng, 300, 700, 1);
+  run<sjtu::ranked_map<int, int>>(rng, 300, 700, 1);
+  // large enough to be split among the threads.
+  run<sjtu::map<int, int>>(rng, 6, 100000, 4);
+  run<sjtu::ranked_map<int, int>>(rng, 6, 100000, 4);
+
+  // unequal allocators: merge_from copies the elements it takes.
+  std::pmr::monotonic_buffer_resource first, second;
+  using PmrMap = sjtu::map<int, int, std::less<int>, std::pmr::polymorphic_allocator<sjtu::pair<const int, int>>>;
+  PmrMap lhs(&first), rhs(&second);
+  Ref expected, left;
+  for (int i = 0; i < 300; ++i) {
+    lhs[i * 2] = i;
+    rhs[i * 3] = -i;
+    expected[i * 2] = i;
+  }
+  for (int i = 0; i < 300; ++i) {
+    if (!expected.emplace(i * 3, -i).second) left.emplace(i * 3, -i);
+  }
+  lhs.merge_from(rhs);
+  check(lhs, expected);
+  check(rhs, left);
+  std::puts("set_ops ok");
+}
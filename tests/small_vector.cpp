@@ -0,0 +1,169 @@
+// small_vector: no allocations while the elements fit
+// inline, the move to the heap and back, and copies and
+// moves between inline and heap small_vectors, against
+// std::vector.
+#include "test.hpp"
+#include "small_vector.hpp"
+
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+size_t allocations = 0;
+size_t live = 0;
+
+/// sjtu::allocator, counting the buffers it hands out.
+template <typename T>
+class CountingAllocator : public sjtu::allocator<T> {
+ public:
+  CountingAllocator () = default;
+  template <typename U>
+  CountingAllocator (const CountingAllocator<U> &/* unused */) noexcept {}
+  auto allocate (size_t n) -> T * {
+    ++allocations;
+    ++live;
+    return sjtu::allocator<T>::allocate(n);
+  }
+  auto deallocate (T *p, size_t n) noexcept -> void {
+    --live;
+    sjtu::allocator<T>::deallocate(p, n);
+  }
+  template <typename U>
+  struct rebind {
+    using other = CountingAllocator<U>;
+  };
+};
+
+constexpr size_t kInline = 4;
+using Small = sjtu::small_vector<std::string, kInline, sjtu::doubling_growth, CountingAllocator<std::string>>;
+using Ref = std::vector<std::string>;
+
+/// Whether the elements of vector live inside the object.
+auto isInline (const Small &vector) -> bool {
+  const auto *object = reinterpret_cast<const char *>(&vector);
+  const auto *data = reinterpret_cast<const char *>(vector.cbegin().operator->());
+  return data >= object && data < object + sizeof(vector);
+}
+
+auto same (const Small &vector, const Ref &ref) -> bool {
+  if (vector.size() != ref.size()) return false;
+  for (size_t i = 0; i < ref.size(); ++i) {
+    if (vector[i] != ref[i]) return false;
+  }
+  return true;
+}
+
+/// A vector of n long strings, which do allocate.
+auto make (size_t n, Ref &ref) -> Small {
+  Small vector;
+  ref.clear();
+  for (size_t i = 0; i < n; ++i) {
+    vector.push_back(std::to_string(i) + std::string(30, 'x'));
+    ref.push_back(std::to_string(i) + std::string(30, 'x'));
+  }
+  return vector;
+}
+
+auto transition () -> void {
+  Small vector;
+  Ref ref;
+  allocations = 0;
+  for (size_t i = 0; i < kInline; ++i) {
+    vector.push_back(std::to_string(i));
+    ref.push_back(std::to_string(i));
+    CHECK(vector.capacity() == kInline && isInline(vector));
+  }
+  CHECK(allocations == 0 && same(vector, ref));
+  // the inline buffer is full, and the new element is one of its own.
+  vector.push_back(vector[0]);
+  ref.push_back(ref[0]);
+  CHECK(allocations == 1 && !isInline(vector) && vector.capacity() > kInline && same(vector, ref));
+  vector.insert(size_t(0), vector[4]);
+  ref.insert(ref.begin(), std::string(ref[4]));
+  CHECK(same(vector, ref));
+  // back inline once it fits again.
+  while (vector.size() > kInline) {
+    vector.pop_back();
+    ref.pop_back();
+  }
+  vector.shrink_to_fit();
+  CHECK(isInline(vector) && vector.capacity() == kInline && same(vector, ref) && live == 0);
+  vector.reserve(kInline + 1);
+  CHECK(!isInline(vector) && same(vector, ref));
+  vector.clear();
+  CHECK(isInline(vector) && vector.empty() && live == 0);
+}
+
+auto copiesAndMoves () -> void {
+  for (size_t lhsSize : { size_t(0), size_t(2), kInline, kInline + 3 }) {
+    for (size_t rhsSize : { size_t(0), size_t(3), kInline, kInline + 5 }) {
+      Ref lhsRef, rhsRef;
+      Small lhs = make(lhsSize, lhsRef);
+      Small rhs = make(rhsSize, rhsRef);
+      Small copy(rhs);
+      CHECK(same(copy, rhsRef) && same(rhs, rhsRef) && isInline(copy) == (rhsSize <= kInline));
+      lhs = copy;
+      CHECK(same(lhs, rhsRef) && same(copy, rhsRef));
+      lhs = make(lhsSize, lhsRef);
+      Small moved(std::move(copy));
+      CHECK(same(moved, rhsRef) && copy.empty() && isInline(copy));
+      lhs = std::move(moved);
+      CHECK(same(lhs, rhsRef) && moved.empty() && isInline(moved));
+      // moved-from vectors stay usable.
+      moved.push_back("again");
+      CHECK(moved.size() == 1 && moved[0] == "again");
+    }
+  }
+  CHECK(live == 0);
+}
+
+auto random (std::mt19937 &rng) -> void {
+  Small vector;
+  Ref ref;
+  for (int op = 0; op < 20000; ++op) {
+    std::string value = std::to_string(rng() % 100);
+    switch (rng() % 6) {
+      case 0: case 1:
+        vector.push_back(value);
+        ref.push_back(value);
+        break;
+      case 2:
+        if (!ref.empty()) {
+          size_t ix = rng() % ref.size();
+          vector.erase(ix);
+          ref.erase(ref.begin() + static_cast<std::ptrdiff_t>(ix));
+        }
+        break;
+      case 3: {
+        size_t ix = rng() % (ref.size() + 1);
+        vector.insert(ix, value);
+        ref.insert(ref.begin() + static_cast<std::ptrdiff_t>(ix), value);
+        break;
+      }
+      case 4:
+        if (!ref.empty()) {
+          vector.pop_back();
+          ref.pop_back();
+        }
+        break;
+      default:
+        vector.shrink_to_fit();
+        CHECK(isInline(vector) == (ref.size() <= kInline));
+    }
+    CHECK(same(vector, ref));
+  }
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  std::mt19937 rng(test::seedArg(argc, argv));
+  transition();
+  copiesAndMoves();
+  random(rng);
+  CHECK(live == 0);
+  std::puts("small_vector ok");
+}
@@ -0,0 +1,153 @@
+// map::split_at and splice against std::map, checking the
+// red-black invariants and exact sizes after every split
+// and join, for plain and ranked maps, and across unequal
+// allocators.
+#include "test.hpp"
+#include "map.hpp"
+
+#include <iterator>
+#include <map>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+namespace {
+
+using Ref = std::map<int, std::string>;
+
+/// Moves the elements of ref with keys not less than key into rest.
+auto splitRef (Ref &ref, int key, Ref &rest) -> void {
+  rest.clear();
+  for (auto it = ref.lower_bound(key); it != ref.end();) {
+    rest.insert(*it);
+    it = ref.erase(it);
+  }
+}
+
+/// Whether the keys of lhs and rhs interleave, so that they cannot be spliced.
+auto overlap (const Ref &lhs, const Ref &rhs) -> bool {
+  if (lhs.empty() || rhs.empty()) return false;
+  return !(lhs.rbegin()->first < rhs.begin()->first || rhs.rbegin()->first < lhs.begin()->first);
+}
+
+template <typename Map>
+auto check (const Map &map, const Ref &ref) -> void {
+  CHECK(map.valid());
+  CHECK(test::same(map, ref));
+  if constexpr (!std::is_same_v<Map, sjtu::map<int, std::string>>) {
+    size_t i = 0;
+    for (const auto &entry : ref) CHECK(map.rank(entry.first) == i++);
+  }
+}
+
+template <typename Map>
+auto run (std::mt19937 &rng) -> void {
+  constexpr int kMaps = 4;
+  for (int round = 0; round < 100; ++round) {
+    Map maps[kMaps];
+    Ref refs[kMaps];
+    for (int op = 0; op < 400; ++op) {
+      int a = static_cast<int>(rng() % kMaps);
+      int b = static_cast<int>(rng() % kMaps);
+      int key = static_cast<int>(rng() % 600);
+      switch (rng() % 10) {
+        case 0: case 1: case 2: case 3:
+          maps[a][key] = std::to_string(op);
+          refs[a][key] = std::to_string(op);
+          break;
+        case 4:
+          maps[a].erase_if([key] (const auto &entry) { return entry.first % 7 == key % 7; });
+          for (auto it = refs[a].begin(); it != refs[a].end();) {
+            it = it->first % 7 == key % 7 ? refs[a].erase(it) : std::next(it);
+          }
+          break;
+        case 5: case 6: {
+          if (a == b) break;
+          Map rest = maps[a].split_at(key);
+          splitRef(refs[a], key, refs[b]);
+          check(maps[a], refs[a]);
+          check(rest, refs[b]);
+          // splitting again at the same key moves nothing.
+          CHECK(maps[a].split_at(key).empty());
+          maps[b].clear();
+          maps[b].splice(rest);
+          CHECK(rest.empty() && rest.valid());
+          break;
+        }
+        case 7: case 8: {
+          if (a == b) break;
+          bool threw = false;
+          try {
+            maps[a].splice(maps[b]);
+          } catch (sjtu::runtime_error &) {
+            threw = true;
+          }
+          CHECK(threw == overlap(refs[a], refs[b]));
+          if (!threw) {
+            refs[a].insert(refs[b].begin(), refs[b].end());
+            refs[b].clear();
+          }
+          break;
+        }
+        default:
+          maps[a] = maps[b];
+          refs[a] = refs[b];
+      }
+      if (op % 20 == 0) check(maps[a], refs[a]);
+    }
+    for (int i = 0; i < kMaps; ++i) check(maps[i], refs[i]);
+  }
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  std::mt19937 rng(test::seedArg(argc, argv));
+  run<sjtu::map<int, std::string>>(rng);
+  run<sjtu::ranked_map<int, std::string>>(rng);
+
+  // splits and joins of a large map, at random keys.
+  sjtu::map<int, int> big;
+  for (int i = 0; i < 100000; ++i) big[i] = i;
+  for (int i = 0; i < 1000; ++i) {
+    int key = static_cast<int>(rng() % 100000);
+    auto rest = big.split_at(key);
+    CHECK(big.size() == static_cast<size_t>(key) && rest.size() == static_cast<size_t>(100000 - key));
+    if (i % 100 == 0) CHECK(big.valid() && rest.valid());
+    if (i % 2 == 0) {
+      big.splice(rest);
+    } else {
+      rest.splice(big);
+      big = rest;
+    }
+  }
+  CHECK(big.valid() && big.size() == 100000);
+
+  // size() is a plain read, even right after a split, so
+  // readers on other threads may call it at once.
+  auto tail = big.split_at(70000);
+  const auto &frozen = big;
+  size_t sizes[2] = { 0, 0 };
+  std::thread reader([&] { sizes[0] = frozen.size(); });
+  sizes[1] = frozen.size();
+  reader.join();
+  CHECK(sizes[0] == 70000 && sizes[1] == 70000 && tail.size() == 30000);
+  big.splice(tail);
+
+  // unequal allocators: the elements are copied, not moved.
+  std::pmr::monotonic_buffer_resource first, second;
+  using PmrMap = sjtu::map<int, int, std::less<int>, std::pmr::polymorphic_allocator<sjtu::pair<const int, int>>>;
+  PmrMap lhs(&first), rhs(&second);
+  for (int i = 0; i < 50; ++i) {
+    lhs[i] = i;
+    rhs[i + 100] = i;
+  }
+  lhs.splice(rhs);
+  CHECK(lhs.valid() && lhs.size() == 100 && rhs.empty());
+  PmrMap rest = lhs.split_at(50);
+  CHECK(lhs.size() == 50 && rest.size() == 50 && rest.get_allocator() == lhs.get_allocator());
+  CHECK(lhs.valid() && rest.valid() && rest.begin()->first == 100);
+  std::puts("split_splice ok");
+}
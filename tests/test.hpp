@@ -0,0 +1,44 @@
+#ifndef SJTU_TESTS_TEST_HPP_
+#define SJTU_TESTS_TEST_HPP_
+
+#include <cstdio>
+#include <cstdlib>
+
+/**
+ * Helpers shared by the test drivers in tests/, each of
+ * which is a standalone program checking the containers
+ * against their std counterparts on random operations, and
+ * aborting on the first failure. See the Makefile for how
+ * they are built and run.
+ */
+namespace test {
+
+[[noreturn]] inline auto fail (const char *what, const char *file, int line) -> void {
+  std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, what);
+  std::abort();
+}
+
+/// The seed of the driver, from its first argument if any.
+inline auto seedArg (int argc, char **argv, unsigned fallback = 1) -> unsigned {
+  if (argc <= 1) return fallback;
+  return static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10));
+}
+
+/// Whether map holds the same elements as ref, in the same order.
+template <typename Map, typename Ref>
+auto same (const Map &map, const Ref &ref) -> bool {
+  if (map.size() != ref.size() || map.empty() != ref.empty()) return false;
+  auto it = map.cbegin();
+  for (const auto &entry : ref) {
+    if (it == map.cend() || it->first != entry.first || it->second != entry.second) return false;
+    ++it;
+  }
+  return it == map.cend();
+}
+
+} // namespace test
+
+/// Checks cond, even under NDEBUG.
+#define CHECK(cond) ((cond) ? (void)0 : ::test::fail(#cond, __FILE__, __LINE__))
+
+#endif // SJTU_TESTS_TEST_HPP_
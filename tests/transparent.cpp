@@ -0,0 +1,172 @@
+// Heterogeneous lookup: map with std::less<> and a custom
+// transparent comparator, for plain, ranked and B+-tree
+// maps, against the same lookups by the key itself; and
+// linked_hashmap with a transparent hash and equality. A
+// detection trait checks at compile time that without
+// is_transparent, the heterogeneous overloads do not exist.
+#include "test.hpp"
+#include "map.hpp"
+#include "linked_hashmap.hpp"
+
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace {
+
+/// Whether map.find(key) is well-formed for a key of type K.
+template <typename Map, typename K, typename = void>
+struct CanFind : std::false_type {};
+template <typename Map, typename K>
+struct CanFind<Map, K, std::void_t<decltype(std::declval<const Map &>().find(std::declval<const K &>()))>>
+  : std::true_type {};
+
+/// Whether map.lower_bound(key) is well-formed for a key of type K.
+template <typename Map, typename K, typename = void>
+struct CanBound : std::false_type {};
+template <typename Map, typename K>
+struct CanBound<Map, K, std::void_t<decltype(std::declval<const Map &>().lower_bound(std::declval<const K &>()))>>
+  : std::true_type {};
+
+/// A key that cannot be made from its id, so that a lookup by id converts nothing.
+class Account {
+ public:
+  Account (int id, std::string owner) : id(id), owner(std::move(owner)) {}
+  int id;
+  std::string owner;
+};
+
+/// Orders accounts by id, and compares them with plain ids.
+struct ById {
+  using is_transparent = void;
+  auto operator() (const Account &lhs, const Account &rhs) const -> bool { return lhs.id < rhs.id; }
+  auto operator() (const Account &lhs, int rhs) const -> bool { return lhs.id < rhs; }
+  auto operator() (int lhs, const Account &rhs) const -> bool { return lhs < rhs.id; }
+};
+
+struct OpaqueById {
+  auto operator() (const Account &lhs, const Account &rhs) const -> bool { return lhs.id < rhs.id; }
+};
+
+struct StringHash {
+  using is_transparent = void;
+  auto operator() (std::string_view key) const -> size_t { return std::hash<std::string_view>()(key); }
+};
+
+using Names = sjtu::map<std::string, int, std::less<>>;
+using Accounts = sjtu::map<Account, int, ById>;
+
+static_assert(CanFind<Names, std::string_view>::value && CanBound<Names, std::string_view>::value);
+static_assert(!CanFind<sjtu::map<std::string, int>, std::string_view>::value);
+static_assert(!CanBound<sjtu::map<std::string, int>, std::string_view>::value);
+static_assert(CanFind<Accounts, int>::value && CanBound<Accounts, int>::value);
+static_assert(!CanFind<sjtu::map<Account, int, OpaqueById>, int>::value);
+static_assert(!CanBound<sjtu::map<Account, int, OpaqueById>, int>::value);
+static_assert(CanFind<sjtu::btree_map<std::string, int, std::less<>>, std::string_view>::value);
+static_assert(!CanFind<sjtu::btree_map<std::string, int>, std::string_view>::value);
+static_assert(CanFind<sjtu::linked_hashmap<std::string, int, StringHash, std::equal_to<>>, std::string_view>::value);
+// both the hash and the equality must be transparent.
+static_assert(!CanFind<sjtu::linked_hashmap<std::string, int, StringHash>, std::string_view>::value);
+static_assert(!CanFind<sjtu::linked_hashmap<std::string, int, std::hash<std::string>, std::equal_to<>>, std::string_view>::value);
+
+template <typename Map, typename It>
+auto sameIt (const Map &map, It lhs, It rhs) -> bool {
+  if ((lhs == map.cend()) != (rhs == map.cend())) return false;
+  return lhs == map.cend() || lhs->first == rhs->first;
+}
+
+/// Looks every name up by std::string, const char * and std::string_view.
+template <typename Map>
+auto names (std::mt19937 &rng) -> void {
+  Map map;
+  for (int i = 0; i < 500; ++i) map[std::to_string(rng() % 1000)] = i;
+  const Map &view = map;
+  for (int i = -1; i < 1001; ++i) {
+    std::string key = std::to_string(i);
+    const char *chars = key.c_str();
+    std::string_view sv = key;
+    auto expected = view.find(key);
+    CHECK(sameIt(view, view.find(chars), expected) && sameIt(view, view.find(sv), expected));
+    CHECK(map.count(sv) == map.count(key) && map.count(chars) == map.count(key));
+    CHECK(sameIt(view, view.lower_bound(sv), view.lower_bound(key)));
+    CHECK(sameIt(view, view.upper_bound(sv), view.upper_bound(key)));
+    auto range = view.equal_range(sv);
+    CHECK(range.first == view.lower_bound(key) && range.second == view.upper_bound(key));
+    if (expected != view.cend()) {
+      CHECK(map.at(sv) == expected->second && view.at(chars) == expected->second);
+      // the mutable overloads find the same element.
+      map.find(sv)->second += 1;
+      CHECK(view.at(key) == expected->second);
+    } else {
+      bool threw = false;
+      try {
+        map.at(sv);
+      } catch (sjtu::index_out_of_bound &) {
+        threw = true;
+      }
+      CHECK(threw);
+    }
+  }
+}
+
+template <typename Map>
+auto accounts () -> void {
+  Map map;
+  for (int i = 0; i < 200; ++i) map[Account(i * 3, "owner" + std::to_string(i))] = i;
+  for (int id = -5; id < 610; ++id) {
+    auto it = map.find(id);
+    CHECK((it != map.end()) == (id % 3 == 0 && id >= 0 && id < 600));
+    if (it != map.end()) CHECK(it->first.id == id && it->second == id / 3 && map.at(id) == id / 3);
+    auto lower = map.lower_bound(id);
+    auto upper = map.upper_bound(id);
+    int next = id < 0 ? 0 : (id + 2) / 3 * 3;
+    CHECK(next >= 600 ? lower == map.end() : lower->first.id == next);
+    CHECK(map.count(id) == (it != map.end() ? 1u : 0u));
+    if (it != map.end()) {
+      ++it;
+      CHECK(upper == it);
+    } else {
+      CHECK(upper == lower);
+    }
+  }
+}
+
+auto hashed () -> void {
+  sjtu::linked_hashmap<std::string, int, StringHash, std::equal_to<>> map;
+  for (int i = 0; i < 300; ++i) map[std::to_string(i * 7)] = i;
+  const auto &view = map;
+  for (int i = 0; i < 2100; ++i) {
+    std::string key = std::to_string(i);
+    std::string_view sv = key;
+    bool has = i % 7 == 0;
+    CHECK(map.count(sv) == (has ? 1u : 0u) && map.count(key.c_str()) == map.count(key));
+    CHECK((map.find(sv) != map.end()) == has && (view.find(sv) != view.cend()) == has);
+    if (has) {
+      CHECK(map.find(sv) == map.find(key) && map.at(sv) == i / 7 && view.at(key.c_str()) == i / 7);
+    } else {
+      bool threw = false;
+      try {
+        view.at(sv);
+      } catch (sjtu::index_out_of_bound &) {
+        threw = true;
+      }
+      CHECK(threw);
+    }
+  }
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  std::mt19937 rng(test::seedArg(argc, argv));
+  names<Names>(rng);
+  names<sjtu::ranked_map<std::string, int, std::less<>>>(rng);
+  names<sjtu::btree_map<std::string, int, std::less<>>>(rng);
+  accounts<Accounts>();
+  accounts<sjtu::btree_map<Account, int, ById>>();
+  hashed();
+  std::puts("transparent ok");
+}
@@ -0,0 +1,101 @@
+// map::try_emplace and insert_or_assign, with lvalue and
+// rvalue keys, for plain, ranked and B+-tree maps: a new key
+// is copied or moved into its element exactly once, and when
+// the key is already there, neither the key nor the
+// arguments are moved from, and nothing is constructed.
+#include "test.hpp"
+#include "map.hpp"
+
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace {
+
+size_t copies = 0;
+size_t moves = 0;
+
+/// A key that counts its copies and moves, and knows whether it was moved from.
+class Key {
+ public:
+  explicit Key (int id) : id(id) {}
+  Key (const Key &other) : id(other.id) { ++copies; }
+  Key (Key &&other) noexcept : id(other.id), movedFrom(false) {
+    other.movedFrom = true;
+    ++moves;
+  }
+  auto operator= (const Key &other) -> Key & = default;
+  auto operator< (const Key &rhs) const -> bool { return id < rhs.id; }
+  int id;
+  bool movedFrom = false;
+};
+
+template <typename Map>
+auto run () -> void {
+  // a B+-tree copies keys into its inner nodes when it splits.
+  constexpr bool kSeparators = std::is_same_v<Map, sjtu::btree_map<Key, std::unique_ptr<int>>>;
+  Map map;
+  for (int i = 0; i < 300; ++i) map.try_emplace(Key(i * 2), std::make_unique<int>(i));
+  CHECK(map.size() == 300 && map.valid());
+
+  // rvalue key and argument, key present: both stay as they are.
+  copies = moves = 0;
+  Key key(100);
+  auto value = std::make_unique<int>(-1);
+  auto res1 = map.try_emplace(std::move(key), std::move(value));
+  CHECK(!res1.second && res1.first->first.id == 100 && *res1.first->second == 50);
+  CHECK(!key.movedFrom && value != nullptr && *value == -1 && copies == 0 && moves == 0);
+
+  // lvalue key, key present.
+  auto res2 = map.try_emplace(key, std::move(value));
+  CHECK(!res2.second && value != nullptr && copies == 0 && moves == 0);
+
+  // rvalue key, key new: moved in once, never copied.
+  Key fresh(101);
+  auto res3 = map.try_emplace(std::move(fresh), std::move(value));
+  CHECK(res3.second && res3.first->first.id == 101 && *res3.first->second == -1);
+  CHECK(fresh.movedFrom && value == nullptr && (copies == 0 || kSeparators) && moves == 1);
+  CHECK(!res3.first->first.movedFrom);
+
+  // lvalue key, key new: copied in once.
+  copies = moves = 0;
+  Key other(103);
+  auto res4 = map.try_emplace(other, std::make_unique<int>(7));
+  CHECK(res4.second && !other.movedFrom && (copies == 1 || kSeparators) && moves == 0);
+
+  // insert_or_assign: assigning leaves the key alone, but takes the value.
+  copies = moves = 0;
+  Key again(101);
+  value = std::make_unique<int>(11);
+  auto res5 = map.insert_or_assign(std::move(again), std::move(value));
+  CHECK(!res5.second && *res5.first->second == 11 && value == nullptr);
+  CHECK(!again.movedFrom && copies == 0 && moves == 0);
+  // inserting moves the key in.
+  Key newer(105);
+  auto res6 = map.insert_or_assign(std::move(newer), std::make_unique<int>(13));
+  CHECK(res6.second && *res6.first->second == 13 && newer.movedFrom && (copies == 0 || kSeparators) && moves == 1);
+  auto res7 = map.insert_or_assign(Key(107), std::make_unique<int>(17));
+  CHECK(res7.second && map.at(Key(107)) != nullptr && *map.at(Key(107)) == 17);
+  CHECK(map.size() == 304 && map.valid());
+}
+
+} // namespace
+
+auto main () -> int {
+  using Value = std::unique_ptr<int>;
+  run<sjtu::map<Key, Value>>();
+  run<sjtu::ranked_map<Key, Value>>();
+  run<sjtu::btree_map<Key, Value>>();
+
+  // std::string keys, which moving empties in practice.
+  sjtu::map<std::string, std::string> map;
+  std::string key(40, 'k');
+  std::string value(40, 'v');
+  map.try_emplace(key, "first");
+  auto res8 = map.try_emplace(std::move(key), std::move(value));
+  CHECK(!res8.second && key == std::string(40, 'k') && value == std::string(40, 'v'));
+  auto res9 = map.insert_or_assign(std::move(key), std::move(value));
+  CHECK(!res9.second && key == std::string(40, 'k') && res9.first->second == std::string(40, 'v'));
+  std::puts("try_emplace ok");
+}
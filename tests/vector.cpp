@@ -0,0 +1,285 @@
+// vector against std::vector: insertions of its own
+// elements, range insert, erase and assign at the front,
+// middle and end, random operations under every growth
+// policy, iterator arithmetic and std::sort, the access
+// policies and allocator propagation on move.
+#include "test.hpp"
+#include "vector.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <memory_resource>
+#include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+template <typename Vector, typename Ref>
+auto same (const Vector &vector, const Ref &ref) -> bool {
+  if (vector.size() != ref.size() || vector.empty() != ref.empty()) return false;
+  if (vector.capacity() < vector.size()) return false;
+  for (size_t i = 0; i < ref.size(); ++i) {
+    if (!(vector[i] == ref[i])) return false;
+  }
+  return static_cast<size_t>(vector.cend() - vector.cbegin()) == ref.size();
+}
+
+/// Inserting and emplacing copies of the vector's own elements, which move as it grows.
+template <typename Vector>
+auto aliasing () -> void {
+  for (size_t n : { 1, 3, 4, 5, 8, 17 }) {
+    Vector vector;
+    std::vector<std::string> ref;
+    for (size_t i = 0; i < n; ++i) {
+      vector.push_back(std::to_string(i) + std::string(20, 'x'));
+      ref.push_back(std::to_string(i) + std::string(20, 'x'));
+    }
+    vector.shrink_to_fit();
+    // full, so that every insertion reallocates.
+    for (size_t round = 0; round < 3; ++round) {
+      size_t from = ref.size() - 1;
+      vector.insert(vector.begin(), vector[from]);
+      ref.insert(ref.begin(), std::string(ref[from]));
+      vector.insert(size_t(ref.size() / 2), vector[0]);
+      ref.insert(ref.begin() + static_cast<std::ptrdiff_t>(ref.size() / 2), std::string(ref[0]));
+      vector.emplace(vector.begin() + 1, vector[ref.size() - 1]);
+      ref.emplace(ref.begin() + 1, std::string(ref[ref.size() - 1]));
+      vector.emplace_back(vector[0]);
+      ref.emplace_back(std::string(ref[0]));
+      vector.push_back(vector[1]);
+      ref.push_back(std::string(ref[1]));
+      vector.insert(vector.end(), 3, vector[2]);
+      ref.insert(ref.end(), 3, std::string(ref[2]));
+      vector.insert(size_t(0), 5, vector[ref.size() - 1]);
+      ref.insert(ref.begin(), 5, std::string(ref[ref.size() - 1]));
+      CHECK(same(vector, ref));
+    }
+  }
+}
+
+/// Range insert, erase and assign at the front, middle and end.
+template <typename Vector>
+auto ranges () -> void {
+  std::vector<std::string> source;
+  for (int i = 0; i < 40; ++i) source.push_back("s" + std::to_string(i));
+  std::list<std::string> list(source.begin(), source.end());
+  for (size_t n : { 0, 1, 10, 33 }) {
+    for (size_t k : { 0, 1, 7, 40 }) {
+      for (int where = 0; where < 3; ++where) {
+        Vector vector;
+        std::vector<std::string> ref;
+        for (size_t i = 0; i < n; ++i) {
+          vector.push_back(std::to_string(i));
+          ref.push_back(std::to_string(i));
+        }
+        size_t ix = where == 0 ? 0 : where == 1 ? n / 2 : n;
+        auto offset = static_cast<std::ptrdiff_t>(ix);
+        auto count = static_cast<std::ptrdiff_t>(k);
+        // random access, bidirectional and single-pass input.
+        auto it = vector.insert(vector.begin() + offset, source.begin(), source.begin() + count);
+        ref.insert(ref.begin() + offset, source.begin(), source.begin() + count);
+        CHECK(it - vector.begin() == offset && same(vector, ref));
+        vector.insert(ix, list.begin(), std::next(list.begin(), count));
+        ref.insert(ref.begin() + offset, list.begin(), std::next(list.begin(), count));
+        CHECK(same(vector, ref));
+        std::string words;
+        for (size_t i = 0; i < k; ++i) words += source[i] + " ";
+        std::istringstream in(words);
+        it = vector.insert(vector.begin() + offset, std::istream_iterator<std::string>(in), std::istream_iterator<std::string>());
+        ref.insert(ref.begin() + offset, source.begin(), source.begin() + count);
+        CHECK(it - vector.begin() == offset && same(vector, ref));
+
+        size_t erased = std::min(k, ref.size() - ix);
+        it = vector.erase(vector.begin() + offset, vector.begin() + offset + static_cast<std::ptrdiff_t>(erased));
+        ref.erase(ref.begin() + offset, ref.begin() + offset + static_cast<std::ptrdiff_t>(erased));
+        CHECK(it - vector.begin() == offset && same(vector, ref));
+
+        vector.assign(source.begin() + offset % 10, source.begin() + offset % 10 + count / 2);
+        ref.assign(source.begin() + offset % 10, source.begin() + offset % 10 + count / 2);
+        CHECK(same(vector, ref));
+        std::istringstream again(words);
+        vector.assign(std::istream_iterator<std::string>(again), std::istream_iterator<std::string>());
+        ref.assign(source.begin(), source.begin() + count);
+        CHECK(same(vector, ref));
+        vector.assign(n, "a");
+        ref.assign(n, "a");
+        CHECK(same(vector, ref));
+      }
+    }
+  }
+}
+
+/// Random operations, to be run under each growth policy.
+template <typename Vector>
+auto random (std::mt19937 &rng) -> void {
+  Vector vector;
+  std::vector<int> ref;
+  for (int op = 0; op < 20000; ++op) {
+    int value = static_cast<int>(rng() % 1000);
+    size_t ix = ref.empty() ? 0 : rng() % (ref.size() + 1);
+    switch (rng() % 10) {
+      case 0: case 1: case 2:
+        vector.push_back(value);
+        ref.push_back(value);
+        break;
+      case 3:
+        vector.insert(ix, value);
+        ref.insert(ref.begin() + static_cast<std::ptrdiff_t>(ix), value);
+        break;
+      case 4:
+        if (!ref.empty()) {
+          vector.pop_back();
+          ref.pop_back();
+        }
+        break;
+      case 5:
+        if (ix < ref.size()) {
+          vector.erase(ix);
+          ref.erase(ref.begin() + static_cast<std::ptrdiff_t>(ix));
+        }
+        break;
+      case 6:
+        // shrinking or growing by a few.
+        vector.resize(ix + value % 4, value);
+        ref.resize(ix + value % 4, value);
+        break;
+      case 7:
+        vector.reserve(ix * 2);
+        CHECK(vector.capacity() >= ix * 2);
+        break;
+      case 8:
+        if (op % 50 == 0) {
+          vector.shrink_to_fit();
+          CHECK(vector.capacity() == ref.size() || vector.capacity() == 0);
+        }
+        break;
+      default:
+        if (op % 100 == 0) {
+          Vector copy(vector);
+          Vector moved(std::move(copy));
+          CHECK(copy.empty() && same(moved, ref));
+          vector = std::move(moved);
+        }
+    }
+    CHECK(vector.size() == ref.size());
+  }
+  CHECK(same(vector, ref));
+}
+
+auto iterators (std::mt19937 &rng) -> void {
+  sjtu::vector<int> vector;
+  std::vector<int> ref;
+  for (int i = 0; i < 1000; ++i) {
+    int value = static_cast<int>(rng() % 500);
+    vector.push_back(value);
+    ref.push_back(value);
+  }
+  auto begin = vector.begin();
+  auto end = vector.end();
+  CHECK(end - begin == 1000 && begin + 1000 == end && 1000 + begin == end && end - 1000 == begin);
+  CHECK(begin < end && end > begin && begin <= begin && end >= end);
+  auto it = begin;
+  it += 10;
+  it -= 3;
+  CHECK(it - begin == 7 && it[3] == ref[10] && *(it - 7) == ref[0]);
+  CHECK(std::distance(vector.cbegin(), vector.cend()) == 1000);
+  std::sort(vector.begin(), vector.end());
+  std::sort(ref.begin(), ref.end());
+  CHECK(same(vector, ref));
+  std::sort(vector.begin(), vector.end(), [] (int lhs, int rhs) { return lhs > rhs; });
+  std::reverse(vector.begin(), vector.end());
+  CHECK(same(vector, ref));
+  CHECK(std::lower_bound(vector.cbegin(), vector.cend(), 250) - vector.cbegin() == std::lower_bound(ref.cbegin(), ref.cend(), 250) - ref.cbegin());
+  sjtu::vector<int> other;
+  bool threw = false;
+  try {
+    (void)(vector.begin() - other.begin());
+  } catch (sjtu::invalid_iterator &) {
+    threw = true;
+  }
+  CHECK(threw);
+}
+
+template <typename Access>
+using AccessVector = sjtu::vector<int, sjtu::doubling_growth, sjtu::allocator<int>, 0, Access>;
+
+auto access () -> void {
+  AccessVector<sjtu::checked_access> checked;
+  AccessVector<sjtu::unchecked_access> unchecked;
+  checked.push_back(1);
+  unchecked.push_back(1);
+  bool threw = false;
+  try {
+    (void)checked[1];
+  } catch (sjtu::index_out_of_bound &) {
+    threw = true;
+  }
+  CHECK(threw && unchecked[0] == 1);
+  threw = false;
+  try {
+    (void)unchecked.at(1);
+  } catch (sjtu::index_out_of_bound &) {
+    threw = true;
+  }
+  CHECK(threw);
+}
+
+/// A stateful allocator that propagates on move assignment.
+template <typename T>
+class Propagating {
+ public:
+  using value_type = T;
+  using propagate_on_container_move_assignment = std::true_type;
+  int id;
+  explicit Propagating (int id = 0) : id(id) {}
+  template <typename U>
+  Propagating (const Propagating<U> &other) : id(other.id) {}
+  auto allocate (size_t n) -> T * { return sjtu::allocator<T>().allocate(n); }
+  auto deallocate (T *p, size_t n) -> void { sjtu::allocator<T>().deallocate(p, n); }
+  auto operator== (const Propagating &rhs) const -> bool { return id == rhs.id; }
+  auto operator!= (const Propagating &rhs) const -> bool { return id != rhs.id; }
+};
+
+auto allocators () -> void {
+  using Pmr = sjtu::vector<int, sjtu::doubling_growth, std::pmr::polymorphic_allocator<int>>;
+  using Moving = sjtu::vector<int, sjtu::doubling_growth, Propagating<int>>;
+  static_assert(std::is_nothrow_move_assignable_v<sjtu::vector<int>>);
+  static_assert(std::is_nothrow_move_assignable_v<Moving>);
+  static_assert(!std::is_nothrow_move_assignable_v<Pmr>);
+
+  Moving lhs(Propagating<int>(1)), rhs(Propagating<int>(2));
+  for (int i = 0; i < 10; ++i) rhs.push_back(i);
+  const int *data = &rhs[0];
+  lhs = std::move(rhs);
+  CHECK(&lhs[0] == data && lhs.get_allocator().id == 2 && lhs.size() == 10 && rhs.empty());
+
+  // unequal pmr allocators stay put, so the elements move one by one.
+  std::pmr::monotonic_buffer_resource first, second;
+  Pmr pmrLhs(&first), pmrRhs(&second);
+  for (int i = 0; i < 10; ++i) pmrRhs.push_back(i);
+  pmrLhs = std::move(pmrRhs);
+  CHECK(pmrLhs.size() == 10 && pmrLhs[9] == 9 && pmrLhs.get_allocator().resource() == &first);
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  std::mt19937 rng(test::seedArg(argc, argv));
+  aliasing<sjtu::vector<std::string>>();
+  aliasing<sjtu::vector<std::string, sjtu::golden_growth>>();
+  ranges<sjtu::vector<std::string>>();
+  ranges<sjtu::vector<std::string, sjtu::page_growth<>>>();
+  random<sjtu::vector<int>>(rng);
+  random<sjtu::vector<int, sjtu::golden_growth>>(rng);
+  random<sjtu::vector<int, sjtu::factor_growth<5, 4>>>(rng);
+  random<sjtu::vector<int, sjtu::page_growth<>>>(rng);
+  random<sjtu::vector<int, sjtu::page_growth<256>>>(rng);
+  iterators(rng);
+  access();
+  allocators();
+  std::puts("vector ok");
+}